@@ -0,0 +1,158 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This compresses the chunks of an incremental transfer one at a time with zstd, when
+ * built with HAVE_ZSTD (make ZSTD=1), so each can go out as soon as it is produced and
+ * be decoded as soon as it arrives. Each chunk is a zstd frame of its own behind a one
+ * byte header, or the raw bytes behind a different one if compressing did not pay.
+ *
+ * A chunk that compresses by less than a sixteenth is sent as it is, and we stop trying
+ * for a while - one chunk, then two, four and so on up to sixteen - so incompressible
+ * data costs little CPU. The first chunk that compresses again resets that. Without
+ * zstd, every chunk is stored, and peers are never offered the compressed type */
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "chunk_codec.h"
+#include "phil_error.h"
+
+// Chunk header values
+enum {
+	ChunkStored = 0,
+	ChunkZstd = 1
+};
+
+// zstd level - the fastest, as the chunks are on the way to the wire
+#define CHUNK_ZSTD_LEVEL 1
+#define CHUNK_MAX_SKIP 16
+
+// This says whether chunks can be compressed at all in this build
+bool isChunkCompressionAvailable(void)
+{
+#ifdef HAVE_ZSTD
+	return true;
+#else
+	return false;
+#endif
+}
+
+// This sets up a codec with nothing sent or received yet
+void initChunkCodec(ChunkCodec *codec)
+{
+	memset(codec, 0, sizeof(*codec));
+#ifdef HAVE_ZSTD
+	codec->compressContext = ZSTD_createCCtx();
+	codec->decompressContext = ZSTD_createDCtx();
+	if (!codec->compressContext || !codec->decompressContext)
+		philError("ZSTD_createCCtx");
+#endif
+}
+
+// This stores a chunk as it is
+static size_t storeChunk(ChunkCodec *codec, const unsigned char *chunk, size_t length,
+	unsigned char *encoded)
+{
+	encoded[0] = ChunkStored;
+	memcpy(encoded + CHUNK_HEADER_BYTES, chunk, length);
+	codec->storedChunks++;
+	return length + CHUNK_HEADER_BYTES;
+}
+
+// This encodes a chunk into encoded, which must have room for length + CHUNK_HEADER_BYTES
+// bytes, returning the encoded length - never more than that
+size_t encodeChunk(ChunkCodec *codec, const unsigned char *chunk, size_t length,
+	unsigned char *encoded)
+{
+	size_t encodedLength = 0;
+
+	codec->rawBytes += length;
+#ifdef HAVE_ZSTD
+	if (codec->skipChunks > 0) {
+		codec->skipChunks--;
+	} else {
+		// Anything that doesn't fit in a sixteenth less than the chunk isn't worth it
+		size_t result = ZSTD_compressCCtx(codec->compressContext,
+			encoded + CHUNK_HEADER_BYTES, length - length / 16, chunk, length,
+			CHUNK_ZSTD_LEVEL);
+		if (!ZSTD_isError(result) && length > 0) {
+			encoded[0] = ChunkZstd;
+			encodedLength = result + CHUNK_HEADER_BYTES;
+			codec->compressedChunks++;
+			codec->skipRun = 0;
+		} else {
+			codec->skipRun = codec->skipRun == 0 ? 1 : codec->skipRun * 2;
+			if (codec->skipRun > CHUNK_MAX_SKIP)
+				codec->skipRun = CHUNK_MAX_SKIP;
+			codec->skipChunks = codec->skipRun;
+		}
+	}
+#endif
+	if (encodedLength == 0)
+		encodedLength = storeChunk(codec, chunk, length, encoded);
+
+	codec->wireBytes += encodedLength;
+	return encodedLength;
+}
+
+// This gives the size an encoded chunk decodes to, or zero if it is malformed - which
+// includes claiming to decode to more than MAX_DECODED_CHUNK_BYTES
+size_t getDecodedChunkSize(const unsigned char *encoded, size_t length)
+{
+	unsigned long long size = 0;
+
+	if (length < CHUNK_HEADER_BYTES)
+		return 0;
+	if (encoded[0] == ChunkStored)
+		size = length - CHUNK_HEADER_BYTES;
+#ifdef HAVE_ZSTD
+	if (encoded[0] == ChunkZstd) {
+		size = ZSTD_getFrameContentSize(encoded + CHUNK_HEADER_BYTES,
+			length - CHUNK_HEADER_BYTES);
+		if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR)
+			size = 0;
+	}
+#endif
+	return size <= MAX_DECODED_CHUNK_BYTES ? size : 0;
+}
+
+// This decodes a chunk into decoded, returning false if it is malformed or too big
+bool decodeChunk(ChunkCodec *codec, const unsigned char *encoded, size_t length,
+	unsigned char *decoded, size_t capacity, size_t *lengthReturn)
+{
+	if (length < CHUNK_HEADER_BYTES)
+		return false;
+	codec->wireBytes += length;
+
+	if (encoded[0] == ChunkStored) {
+		if (length - CHUNK_HEADER_BYTES > capacity)
+			return false;
+		memcpy(decoded, encoded + CHUNK_HEADER_BYTES, length - CHUNK_HEADER_BYTES);
+		*lengthReturn = length - CHUNK_HEADER_BYTES;
+		codec->storedChunks++;
+		codec->rawBytes += *lengthReturn;
+		return true;
+	}
+#ifdef HAVE_ZSTD
+	if (encoded[0] == ChunkZstd) {
+		size_t result = ZSTD_decompressDCtx(codec->decompressContext, decoded, capacity,
+			encoded + CHUNK_HEADER_BYTES, length - CHUNK_HEADER_BYTES);
+		if (ZSTD_isError(result))
+			return false;
+		*lengthReturn = result;
+		codec->compressedChunks++;
+		codec->rawBytes += result;
+		return true;
+	}
+#endif
+	return false;
+}
+
+// This frees the codec's contexts
+void destroyChunkCodec(ChunkCodec *codec)
+{
+#ifdef HAVE_ZSTD
+	ZSTD_freeCCtx(codec->compressContext);
+	ZSTD_freeDCtx(codec->decompressContext);
+#endif
+}
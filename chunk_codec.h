@@ -0,0 +1,37 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for compressing transfer chunks */
+#ifndef CHUNK_CODEC
+#define CHUNK_CODEC
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Every encoded chunk starts with a byte saying how the rest is stored
+#define CHUNK_HEADER_BYTES 1
+
+// The most a chunk may decode to. Senders make chunks of a few hundred kilobytes, and the
+// size a compressed one claims comes from the peer, so anything over this is malformed
+#define MAX_DECODED_CHUNK_BYTES (4 * 1024 * 1024)
+
+// Codec structure - one per direction of a transfer, so contexts are reused across chunks
+typedef struct {
+	void *compressContext;
+	void *decompressContext;
+	int skipChunks;
+	int skipRun;
+	size_t rawBytes;
+	size_t wireBytes;
+	unsigned long compressedChunks;
+	unsigned long storedChunks;
+} ChunkCodec;
+
+bool isChunkCompressionAvailable(void);
+void initChunkCodec(ChunkCodec *codec);
+size_t encodeChunk(ChunkCodec *codec, const unsigned char *chunk, size_t length,
+	unsigned char *encoded);
+size_t getDecodedChunkSize(const unsigned char *encoded, size_t length);
+bool decodeChunk(ChunkCodec *codec, const unsigned char *encoded, size_t length,
+	unsigned char *decoded, size_t capacity, size_t *lengthReturn);
+void destroyChunkCodec(ChunkCodec *codec);
+
+#endif
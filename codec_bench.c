@@ -0,0 +1,139 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This measures what compressing each INCR chunk buys - bytes on the wire, encode and
+ * decode speed, and the time the chunks would take over a link of a given speed - for
+ * the MIDI the source streams and for random bytes, which should cost almost nothing
+ * once the codec notices they don't compress. Chunks are encoded and decoded one at a
+ * time, as they are when the source fills each property on demand. The X round trip per
+ * chunk isn't timed. Build with make ZSTD=1, or every chunk is stored */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "chunk_codec.h"
+#include "midi_stream.h"
+#include "phil_error.h"
+
+/* Print usage and exit */
+static void usage(const char *progName)
+{
+	fprintf(stderr, "Usage: %s [-m megabytes] [-k kilobytes] [-b megabits]\n", progName);
+	fprintf(stderr, "  -m  size of each payload, in megabytes (default 16)\n"
+			"  -k  chunk size, in kilobytes (default 256)\n"
+			"  -b  link speed to estimate wire time for, in Mbit/s (default 1000)\n");
+	exit(EXIT_FAILURE);
+}
+
+/* Nanoseconds from the monotonic clock */
+static uint64_t nowNs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* This encodes a payload a chunk at a time and decodes it again, checking it survives,
+ * and prints one row of results */
+static void runPayload(const char *name, const unsigned char *payload, size_t payloadBytes,
+	size_t chunkBytes, double megabits)
+{
+	ChunkCodec sender, receiver;
+	unsigned char *encoded = malloc(chunkBytes + CHUNK_HEADER_BYTES);
+	unsigned char *decoded = malloc(chunkBytes);
+	uint64_t encodeNs = 0, decodeNs = 0;
+	if (!encoded || !decoded)
+		philError("malloc");
+
+	initChunkCodec(&sender);
+	initChunkCodec(&receiver);
+	for (size_t offset = 0; offset < payloadBytes; offset += chunkBytes) {
+		size_t length = payloadBytes - offset < chunkBytes ? payloadBytes - offset : chunkBytes;
+		size_t decodedLength;
+
+		uint64_t start = nowNs();
+		size_t encodedLength = encodeChunk(&sender, payload + offset, length, encoded);
+		uint64_t middle = nowNs();
+		if (!decodeChunk(&receiver, encoded, encodedLength, decoded, chunkBytes,
+			&decodedLength))
+			philError("codec_bench: chunk at %zu did not decode", offset);
+		decodeNs += nowNs() - middle;
+		encodeNs += middle - start;
+
+		if (decodedLength != length || memcmp(decoded, payload + offset, length) != 0)
+			philError("codec_bench: chunk at %zu decoded differently", offset);
+	}
+
+	// Wire time for the bytes sent, plus the time spent compressing and decompressing
+	double rawMs = payloadBytes * 8 / (megabits * 1e3);
+	double wireMs = sender.wireBytes * 8 / (megabits * 1e3) + (encodeNs + decodeNs) / 1e6;
+	printf("%-8s %12zu %12zu %7.1f%% %6lu/%-6lu %10.1f %10.1f %10.3f %10.3f\n", name,
+		payloadBytes, sender.wireBytes, 100.0 * sender.wireBytes / payloadBytes,
+		sender.compressedChunks, sender.storedChunks,
+		payloadBytes / 1048576.0 / (encodeNs / 1e9), payloadBytes / 1048576.0 / (decodeNs / 1e9),
+		rawMs, wireMs);
+
+	destroyChunkCodec(&sender);
+	destroyChunkCodec(&receiver);
+	free(encoded);
+	free(decoded);
+}
+
+/* Entry point */
+int main(int argc, char **argv)
+{
+	// Variables
+	int opt, megabytes = 16, kilobytes = 256;
+	double megabits = 1000;
+
+	// Parse options
+	while ((opt = getopt(argc, argv, "m:k:b:")) != -1) {
+		switch (opt) {
+		case 'm':
+			megabytes = atoi(optarg);
+			if (megabytes <= 0)
+				usage(argv[0]);
+			break;
+		case 'k':
+			kilobytes = atoi(optarg);
+			if (kilobytes <= 0)
+				usage(argv[0]);
+			break;
+		case 'b':
+			megabits = atof(optarg);
+			if (megabits <= 0)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc)
+		usage(argv[0]);
+
+	// The same MIDI file the source streams, and random bytes of the same size
+	MidiProducer producer;
+	unsigned long notes = (unsigned long)megabytes * 1024 * 1024 / 4;
+	size_t payloadBytes = getMidiFileSize(notes), chunkBytes = (size_t)kilobytes * 1024;
+	unsigned char *payload = malloc(payloadBytes);
+	if (!payload)
+		philError("malloc");
+	initMidiProducer(&producer, 1, notes);
+	for (size_t offset = 0, length; (length = produceMidiChunk(&producer, payload + offset,
+		payloadBytes - offset)) > 0; offset += length)
+		;
+
+	printf("%zu byte chunks, %s, wire time at %.0f Mbit/s\n", chunkBytes,
+		isChunkCompressionAvailable() ? "zstd" : "no compression in this build", megabits);
+	printf("%-8s %12s %12s %8s %13s %10s %10s %10s %10s\n", "payload", "raw bytes",
+		"wire bytes", "wire", "zstd/stored", "enc MB/s", "dec MB/s", "raw ms", "wire ms");
+	runPayload("midi", payload, payloadBytes, chunkBytes, megabits);
+
+	srand(1);
+	for (size_t i = 0; i < payloadBytes; ++i)
+		payload[i] = rand();
+	runPayload("random", payload, payloadBytes, chunkBytes, megabits);
+
+	free(payload);
+	return EXIT_SUCCESS;
+}
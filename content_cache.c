@@ -0,0 +1,108 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This keeps payloads already dropped on a target, keyed by the content hash type
+ * the source offered with them. When the same square comes back, the target finds the
+ * hash among the offered types and uses its own copy instead of converting the selection.
+ *
+ * Type atoms are unique to their names for the life of the server, so the atom itself is
+ * the key - recognising a payload we hold needs no round trip. The cache is bounded by a
+ * memory budget as well as a number of entries, and evicts the least recently used
+ * payload first */
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include "content_cache.h"
+
+// This sets up an empty cache that may hold up to budgetBytes of payloads
+void initContentCache(ContentCache *cache, size_t budgetBytes)
+{
+	memset(cache, 0, sizeof(*cache));
+	cache->budgetBytes = budgetBytes;
+}
+
+// This finds the entry for a key, or NULL
+static CachedContent *findEntry(ContentCache *cache, Atom key)
+{
+	for (int i = 0; i < CONTENT_CACHE_ENTRIES; ++i) {
+		if (cache->entries[i].bytes && cache->entries[i].key == key)
+			return &cache->entries[i];
+	}
+	return NULL;
+}
+
+// This throws an entry away
+static void evictEntry(ContentCache *cache, CachedContent *entry)
+{
+	cache->usedBytes -= entry->size;
+	free(entry->bytes);
+	memset(entry, 0, sizeof(*entry));
+}
+
+// This says whether we hold a payload, without counting it as a use
+bool isContentCached(ContentCache *cache, Atom key)
+{
+	return key != None && findEntry(cache, key) != NULL;
+}
+
+// This looks up a dropped payload, counting a hit or miss - a hit becomes the most
+// recently used entry
+const CachedContent *lookupContentCache(ContentCache *cache, Atom key)
+{
+	CachedContent *entry = key != None ? findEntry(cache, key) : NULL;
+
+	if (!entry) {
+		cache->misses++;
+		return NULL;
+	}
+	cache->hits++;
+	cache->bytesSaved += entry->size;
+	entry->lastUsed = ++cache->clock;
+	return entry;
+}
+
+// This takes ownership of a payload's bytes and keeps them, evicting the least recently
+// used payloads until it fits. Anything bigger than the whole budget is just freed
+void insertContentCache(ContentCache *cache, Atom key, unsigned char *bytes, size_t size)
+{
+	if (key == None || size > cache->budgetBytes) {
+		free(bytes);
+		return;
+	}
+
+	// A payload already held is replaced
+	CachedContent *entry = findEntry(cache, key);
+	if (entry)
+		evictEntry(cache, entry);
+
+	for (;;) {
+		CachedContent *empty = NULL, *oldest = NULL;
+		for (int i = 0; i < CONTENT_CACHE_ENTRIES; ++i) {
+			CachedContent *candidate = &cache->entries[i];
+			if (!candidate->bytes) {
+				if (!empty)
+					empty = candidate;
+			} else if (!oldest || candidate->lastUsed < oldest->lastUsed) {
+				oldest = candidate;
+			}
+		}
+
+		if (empty && cache->usedBytes + size <= cache->budgetBytes) {
+			empty->key = key;
+			empty->bytes = bytes;
+			empty->size = size;
+			empty->lastUsed = ++cache->clock;
+			cache->usedBytes += size;
+			return;
+		}
+		evictEntry(cache, oldest);
+	}
+}
+
+// This frees every payload held
+void destroyContentCache(ContentCache *cache)
+{
+	for (int i = 0; i < CONTENT_CACHE_ENTRIES; ++i) {
+		if (cache->entries[i].bytes)
+			evictEntry(cache, &cache->entries[i]);
+	}
+}
@@ -0,0 +1,39 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for the dropped content cache */
+#ifndef CONTENT_CACHE
+#define CONTENT_CACHE
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <X11/Xlib.h>
+
+// Most payloads held at once, whatever the budget
+#define CONTENT_CACHE_ENTRIES 16
+
+// One payload we hold, keyed by the type atom that names its hash
+typedef struct {
+	Atom key;
+	unsigned char *bytes;
+	size_t size;
+	uint64_t lastUsed;
+} CachedContent;
+
+// Content cache structure - least recently used payloads go first once the budget is spent
+typedef struct {
+	CachedContent entries[CONTENT_CACHE_ENTRIES];
+	size_t budgetBytes;
+	size_t usedBytes;
+	uint64_t clock;
+	unsigned long hits;
+	unsigned long misses;
+	size_t bytesSaved;
+} ContentCache;
+
+void initContentCache(ContentCache *cache, size_t budgetBytes);
+bool isContentCached(ContentCache *cache, Atom key);
+const CachedContent *lookupContentCache(ContentCache *cache, Atom key);
+void insertContentCache(ContentCache *cache, Atom key, unsigned char *bytes, size_t size);
+void destroyContentCache(ContentCache *cache);
+
+#endif
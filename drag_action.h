@@ -0,0 +1,9 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for the actions a drag can perform */
+#ifndef DRAG_ACTION
+#define DRAG_ACTION
+
+// What a drop does with the data - Ask leaves the choice to the target at drop time
+typedef enum { DragCopy = 0, DragMove, DragLink, DragAsk, NumberOfDragActions } DragAction;
+
+#endif
@@ -0,0 +1,128 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This is a small override-redirect window that follows the pointer while the square is
+ * dragged outside its own window. Moving it only records where it should go -
+ * flushDragIcon() is called once the event queue is empty, and sends a single XMoveWindow
+ * for however many motion events arrived in the meantime. Nothing here waits on the
+ * server, so the icon keeps up with high rate mice.
+ *
+ * The icon is translucent when the screen has a 32 bit ARGB visual, and opaque otherwise.
+ * Its input region is emptied with the shape extension where available, so the pointer
+ * falls through to whatever is underneath - target lookup skips it either way */
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/shape.h>
+#include "drag_icon.h"
+#include "phil_error.h"
+
+// How opaque the icon is on an ARGB visual, out of 255
+#define DRAG_ICON_ALPHA 0xC0
+
+// This turns a 0xRRGGBB colour into the pixel value the icon's visual wants
+static unsigned long getIconPixel(DragIcon *icon, unsigned long pixel)
+{
+	if (!icon->argb)
+		return pixel;
+
+	// ARGB visuals expect premultiplied alpha
+	unsigned long red = ((pixel >> 16) & 0xFF) * DRAG_ICON_ALPHA / 255;
+	unsigned long green = ((pixel >> 8) & 0xFF) * DRAG_ICON_ALPHA / 255;
+	unsigned long blue = (pixel & 0xFF) * DRAG_ICON_ALPHA / 255;
+	return ((unsigned long)DRAG_ICON_ALPHA << 24) | (red << 16) | (green << 8) | blue;
+}
+
+// This creates the icon window, unmapped
+void initDragIcon(DragIcon *icon, Display *disp, int size)
+{
+	int screen = DefaultScreen(disp);
+	XVisualInfo visualInfo;
+	XSetWindowAttributes attrs;
+	unsigned long attrMask = CWOverrideRedirect | CWSaveUnder | CWBackPixel | CWBorderPixel;
+	Visual *visual = CopyFromParent;
+	int depth = CopyFromParent;
+	int shapeEvent, shapeError, shapeMajor, shapeMinor;
+
+	memset(icon, 0, sizeof(*icon));
+	icon->disp = disp;
+	icon->size = size;
+
+	// Use an ARGB visual if there is one - it needs its own colormap
+	memset(&attrs, 0, sizeof(attrs));
+	if (XMatchVisualInfo(disp, screen, 32, TrueColor, &visualInfo)) {
+		icon->argb = true;
+		visual = visualInfo.visual;
+		depth = visualInfo.depth;
+		icon->colormap = XCreateColormap(disp, RootWindow(disp, screen), visual, AllocNone);
+		attrs.colormap = icon->colormap;
+		attrMask |= CWColormap;
+	}
+	attrs.override_redirect = True;
+	attrs.save_under = True;
+	attrs.background_pixel = getIconPixel(icon, 0);
+	attrs.border_pixel = 0;
+
+	icon->wind = XCreateWindow(disp, RootWindow(disp, screen), 0, 0, size, size, 0, depth,
+		InputOutput, visual, attrMask, &attrs);
+	if (icon->wind == 0)
+		philError("XCreateWindow");
+
+	// Let the pointer fall through the icon - input shapes need shape 1.1
+	if (XShapeQueryExtension(disp, &shapeEvent, &shapeError) &&
+		XShapeQueryVersion(disp, &shapeMajor, &shapeMinor) &&
+		(shapeMajor > 1 || (shapeMajor == 1 && shapeMinor >= 1)))
+		XShapeCombineRectangles(disp, icon->wind, ShapeInput, 0, 0, NULL, 0, ShapeSet, Unsorted);
+}
+
+// This asks for the icon to be centred on the pointer in the given colour
+void showDragIcon(DragIcon *icon, int rootX, int rootY, unsigned long pixel)
+{
+	icon->visible = true;
+	icon->x = rootX - icon->size / 2;
+	icon->y = rootY - icon->size / 2;
+	icon->pixel = pixel;
+}
+
+// This asks for the icon to be taken down
+void hideDragIcon(DragIcon *icon)
+{
+	icon->visible = false;
+}
+
+// This sends whatever has changed since the last flush - at most one move
+void flushDragIcon(DragIcon *icon)
+{
+	if (!icon->visible) {
+		if (icon->mapped) {
+			XUnmapWindow(icon->disp, icon->wind);
+			icon->mapped = false;
+		}
+		return;
+	}
+
+	// Move before mapping, so the icon never appears where it used to be
+	if (!icon->mapped || icon->x != icon->shownX || icon->y != icon->shownY) {
+		XMoveWindow(icon->disp, icon->wind, icon->x, icon->y);
+		icon->shownX = icon->x;
+		icon->shownY = icon->y;
+		icon->moves++;
+	}
+	if (!icon->mapped || icon->pixel != icon->shownPixel) {
+		XSetWindowBackground(icon->disp, icon->wind, getIconPixel(icon, icon->pixel));
+		XClearWindow(icon->disp, icon->wind);
+		icon->shownPixel = icon->pixel;
+	}
+	if (!icon->mapped) {
+		XMapRaised(icon->disp, icon->wind);
+		icon->mapped = true;
+	}
+}
+
+// This destroys the icon window
+void destroyDragIcon(DragIcon *icon)
+{
+	XDestroyWindow(icon->disp, icon->wind);
+	if (icon->argb)
+		XFreeColormap(icon->disp, icon->colormap);
+}
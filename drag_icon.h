@@ -0,0 +1,33 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for the drag feedback icon */
+#ifndef DRAG_ICON
+#define DRAG_ICON
+
+#include <stdbool.h>
+#include <X11/Xlib.h>
+
+// Drag icon structure - what we want on screen, and what was last sent to the server
+typedef struct {
+	Display *disp;
+	Window wind;
+	Colormap colormap;
+	bool argb;
+	int size;
+	bool visible;
+	int x;
+	int y;
+	unsigned long pixel;
+	bool mapped;
+	int shownX;
+	int shownY;
+	unsigned long shownPixel;
+	unsigned long moves;
+} DragIcon;
+
+void initDragIcon(DragIcon *icon, Display *disp, int size);
+void showDragIcon(DragIcon *icon, int rootX, int rootY, unsigned long pixel);
+void hideDragIcon(DragIcon *icon);
+void flushDragIcon(DragIcon *icon);
+void destroyDragIcon(DragIcon *icon);
+
+#endif
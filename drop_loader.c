@@ -0,0 +1,156 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This loads dropped square state on a worker thread, so the event loop is free to keep
+ * talking to the X server while the file I/O happens. Taking the payload from the source
+ * (copying, moving or linking it) happens on the same thread, and is timed. Payloads small
+ * enough can be read whole and kept, for the target's content cache. A payload whose state
+ * has been read already can be just taken. A payload that can't be taken or read fails the
+ * load, with the reason kept for whoever collects it */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "drop_loader.h"
+#include "drop_transfer.h"
+#include "square_state.h"
+#include "phil_error.h"
+
+// This is the worker thread body - it loads the state then pokes the pipe
+static void *dropLoaderThread(void *arg)
+{
+	DropLoader *loader = arg;
+	char doneByte = 1;
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	const char *loadPath = transferDroppedPayload(loader->pathStr, loader->keptPath,
+		loader->action, &loader->transferBytes);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	loader->transferNs = (uint64_t)(end.tv_sec - start.tv_sec) * 1000000000ULL +
+		end.tv_nsec - start.tv_nsec;
+
+	// Read the whole payload if it is to be kept, and just the state if not
+	struct stat loadStat;
+	if (!loadPath || loader->transferOnly)
+		loader->failed = loadPath == NULL;
+	else if (loader->keepUpTo > 0 && stat(loadPath, &loadStat) == 0 &&
+		(size_t)loadStat.st_size <= loader->keepUpTo) {
+		loader->content = readSquareState(loadPath, &loader->loadedSquare, &loader->contentSize);
+		loader->failed = loader->content == NULL;
+	} else
+		loader->failed = !restoreSquareState(loadPath, &loader->loadedSquare);
+	if (loader->failed)
+		loader->error = errno;
+	if (write(loader->pipeFds[1], &doneByte, 1) != 1)
+		philError("write");
+
+	return NULL;
+}
+
+// This sets up the loader and its completion pipe
+void initDropLoader(DropLoader *loader)
+{
+	loader->busy = false;
+	loader->pathStr = NULL;
+	loader->content = NULL;
+	snprintf(loader->keptPath, sizeof(loader->keptPath), "/tmp/square.%d.dropped.state",
+		(int)getpid());
+	if (pipe(loader->pipeFds) != 0)
+		philError("pipe");
+}
+
+// This starts the worker on a payload, reading its state afterwards unless transferOnly
+static void startDropJob(DropLoader *loader, char *pathStr, DragAction action, size_t keepUpTo,
+	bool transferOnly)
+{
+	// Only one load at a time - callers collect any previous one with finishDropLoad() first
+	if (loader->busy)
+		philError("startDropLoad: load already in progress");
+
+	// Whatever was kept from the last load and not taken goes
+	free(loader->content);
+	loader->content = NULL;
+	loader->contentSize = 0;
+
+	loader->busy = true;
+	loader->transferOnly = transferOnly;
+	loader->failed = false;
+	loader->error = 0;
+	loader->pathStr = pathStr;
+	loader->action = action;
+	loader->keepUpTo = keepUpTo;
+	if (pthread_create(&loader->thread, NULL, dropLoaderThread, loader) != 0)
+		philError("pthread_create");
+}
+
+// This starts loading from the supplied path, taking ownership of the malloc allocated string,
+// and taking the payload the way the drop's action says. Payloads of up to keepUpTo bytes
+// are read whole, for takeDropLoadContent()
+void startDropLoad(DropLoader *loader, char *pathStr, DragAction action, size_t keepUpTo)
+{
+	startDropJob(loader, pathStr, action, keepUpTo, false);
+}
+
+// This just takes the payload at the supplied path the way the action says, for when its
+// state has been read already, taking ownership of the malloc allocated string
+void startDropTransfer(DropLoader *loader, char *pathStr, DragAction action)
+{
+	startDropJob(loader, pathStr, action, 0, true);
+}
+
+// This returns the descriptor that becomes readable once a load completes
+int getDropLoaderFd(DropLoader *loader)
+{
+	return loader->pipeFds[0];
+}
+
+// This collects a completed (or still running) load, blocking if need be, and copies
+// the loaded state onto the supplied square - which may be NULL for a transfer, as that
+// reads none. Returns false if the load failed, leaving the square alone - the reason is
+// in the loader's error
+bool finishDropLoad(DropLoader *loader, Square *square)
+{
+	char doneByte;
+
+	if (!loader->busy)
+		return true;
+
+	if (read(loader->pipeFds[0], &doneByte, 1) != 1)
+		philError("read");
+	if (pthread_join(loader->thread, NULL) != 0)
+		philError("pthread_join");
+
+	if (!loader->failed && !loader->transferOnly)
+		square->colour = loader->loadedSquare.colour;
+	free(loader->pathStr);
+	loader->pathStr = NULL;
+	loader->busy = false;
+	return !loader->failed;
+}
+
+// This hands over the payload read whole by the last load, if it was kept - the caller
+// must free it
+unsigned char *takeDropLoadContent(DropLoader *loader, size_t *sizeReturn)
+{
+	unsigned char *content = loader->content;
+
+	*sizeReturn = loader->contentSize;
+	loader->content = NULL;
+	loader->contentSize = 0;
+	return content;
+}
+
+// This waits for any outstanding load and closes the pipe
+void destroyDropLoader(DropLoader *loader)
+{
+	Square discard;
+
+	finishDropLoad(loader, &discard);
+	free(loader->content);
+	unlink(loader->keptPath);
+	close(loader->pipeFds[0]);
+	close(loader->pipeFds[1]);
+}
@@ -0,0 +1,40 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for the background drop loader */
+#ifndef DROP_LOADER
+#define DROP_LOADER
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "square_state.h"
+#include "drag_action.h"
+
+// Drop loader structure - one load in flight at a time
+typedef struct {
+	pthread_t thread;
+	int pipeFds[2];
+	bool busy;
+	bool transferOnly;
+	bool failed;
+	int error;
+	char *pathStr;
+	DragAction action;
+	char keptPath[64];
+	size_t transferBytes;
+	uint64_t transferNs;
+	size_t keepUpTo;
+	unsigned char *content;
+	size_t contentSize;
+	Square loadedSquare;
+} DropLoader;
+
+void initDropLoader(DropLoader *loader);
+void startDropLoad(DropLoader *loader, char *pathStr, DragAction action, size_t keepUpTo);
+void startDropTransfer(DropLoader *loader, char *pathStr, DragAction action);
+unsigned char *takeDropLoadContent(DropLoader *loader, size_t *sizeReturn);
+int getDropLoaderFd(DropLoader *loader);
+bool finishDropLoad(DropLoader *loader, Square *square);
+void destroyDropLoader(DropLoader *loader);
+
+#endif
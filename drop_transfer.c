@@ -0,0 +1,147 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This takes a dropped payload from the source in the way the drop's action says. A copy
+ * reads the source's file into one we keep. A move of a payload one of our own windows
+ * wrote takes the file over by renaming it, so nothing is copied at all - the source
+ * forgets about it once it sees XdndFinished report a move. A link just uses the source's
+ * file where it is.
+ *
+ * Any other file is only ever copied, even for a move - in XDND it is the source that
+ * deletes the original once told the move was done, and a file dropped from a file manager
+ * must not be renamed into a place we later delete. A move of our own payload across
+ * filesystems can't be a rename, so it falls back to a copy followed by removing the file,
+ * which leaves things as the source expects.
+ *
+ * The source's file may vanish or change under us at any point, so failures are returned
+ * with errno set, for the drop to be failed rather than the process ended */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "drop_transfer.h"
+#include "phil_error.h"
+
+#define COPY_CHUNK_SIZE (1024 * 1024)
+
+static const char *actionNames[NumberOfDragActions] = { "copied", "moved", "linked", "asked" };
+
+// This copies a file, noting how many bytes it held, and returns false if it couldn't -
+// without leaving a partial copy behind
+static bool copyPayload(const char *fromPath, const char *toPath, size_t *bytes)
+{
+	size_t total = 0;
+	ssize_t bytesRead;
+	bool copied = true;
+
+	int fromFd = open(fromPath, O_RDONLY | O_CLOEXEC);
+	if (fromFd < 0)
+		return false;
+	int toFd = open(toPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (toFd < 0) {
+		int openError = errno;
+		close(fromFd);
+		errno = openError;
+		return false;
+	}
+
+	char *chunk = malloc(COPY_CHUNK_SIZE);
+	if (!chunk)
+		philError("malloc");
+	while (copied && (bytesRead = read(fromFd, chunk, COPY_CHUNK_SIZE)) != 0) {
+		if (bytesRead < 0) {
+			if (errno == EINTR)
+				continue;
+			copied = false;
+			break;
+		}
+		for (ssize_t written = 0; written < bytesRead; ) {
+			ssize_t result = write(toFd, chunk + written, bytesRead - written);
+			if (result < 0) {
+				if (errno == EINTR)
+					continue;
+				copied = false;
+				break;
+			}
+			written += result;
+		}
+		total += bytesRead;
+	}
+
+	// Keep the first error, whatever closing does
+	int copyError = errno;
+	free(chunk);
+	close(fromFd);
+	if (close(toFd) != 0 && copied) {
+		copied = false;
+		copyError = errno;
+	}
+	if (!copied) {
+		unlink(toPath);
+		errno = copyError;
+		return false;
+	}
+
+	*bytes = total;
+	return true;
+}
+
+// This gets the size of a file, returning false if it can't be found
+static bool getPayloadSize(const char *pathStr, size_t *bytes)
+{
+	struct stat payloadStat;
+	if (stat(pathStr, &payloadStat) != 0)
+		return false;
+	*bytes = payloadStat.st_size;
+	return true;
+}
+
+// This checks for a payload written by one of our own windows, which are named
+// /tmp/square.<pid>.<generation>.state
+static bool isOwnPayload(const char *pathStr)
+{
+	const char *prefix = "/tmp/square.";
+	if (strncmp(pathStr, prefix, strlen(prefix)) != 0)
+		return false;
+
+	const char *field = pathStr + strlen(prefix);
+	size_t pidDigits = strspn(field, "0123456789");
+	if (pidDigits == 0 || field[pidDigits] != '.')
+		return false;
+	field += pidDigits + 1;
+	size_t generationDigits = strspn(field, "0123456789");
+	return generationDigits > 0 && strcmp(field + generationDigits, ".state") == 0;
+}
+
+// This takes the payload at pathStr, returning the path to read it from - keptPath unless
+// it was linked - or NULL if it couldn't be taken
+const char *transferDroppedPayload(const char *pathStr, const char *keptPath, DragAction action,
+	size_t *bytes)
+{
+	switch (action) {
+	case DragMove:
+		if (!isOwnPayload(pathStr))
+			return copyPayload(pathStr, keptPath, bytes) ? keptPath : NULL;
+		if (rename(pathStr, keptPath) == 0)
+			return getPayloadSize(keptPath, bytes) ? keptPath : NULL;
+		if (errno != EXDEV || !copyPayload(pathStr, keptPath, bytes))
+			return NULL;
+
+		// The copy is what counts - a file we couldn't remove is only left lying about
+		unlink(pathStr);
+		return keptPath;
+	case DragLink:
+		return getPayloadSize(pathStr, bytes) ? pathStr : NULL;
+	default:
+		return copyPayload(pathStr, keptPath, bytes) ? keptPath : NULL;
+	}
+}
+
+const char *getDragActionName(DragAction action)
+{
+	if (action < DragCopy || action >= NumberOfDragActions)
+		return "unknown";
+	return actionNames[action];
+}
@@ -0,0 +1,13 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for taking dropped payloads from the source */
+#ifndef DROP_TRANSFER
+#define DROP_TRANSFER
+
+#include <stddef.h>
+#include "drag_action.h"
+
+const char *transferDroppedPayload(const char *pathStr, const char *keptPath, DragAction action,
+	size_t *bytes);
+const char *getDragActionName(DragAction action);
+
+#endif
@@ -0,0 +1,2266 @@
+/* Copyright Phillip Potter, 2020 - MIT License
+ * Copyright xlib_xdnd contributors, 2026
+ * This contains the logic for handling events, and the XDND state machine behind it */
+#include <sys/types.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include "event_handler.h"
+#include "square_state.h"
+#include "drop_loader.h"
+#include "drop_transfer.h"
+#include "xdnd_timer.h"
+#include "xdnd_session.h"
+#include "phil_error.h"
+#include "xevent_type.h"
+#include "midi_stream.h"
+#include "chunk_codec.h"
+#include "xerror_tracker.h"
+
+#define XDND_PROTOCOL_VERSION 5
+
+// Where audio/midi and its compressed form sit in typesWeAccept, and the most we put in
+// each INCR chunk of either
+#define MIDI_TYPE 6
+#define MIDI_ZSTD_TYPE 7
+#define MIDI_CHUNK_BYTES (256 * 1024)
+
+// Content hash types are named this followed by the hash in hex, and we look through at
+// most this many offered types for one
+#define CONTENT_TYPE_PREFIX "application/x-square-state;hash="
+#define MAX_OFFERED_TYPES 16
+
+// Atom definitions
+static Atom XdndAware, XdndEnter, XdndPosition, XdndActionCopy, XdndActionMove, XdndActionLink,
+	    XdndActionAsk, XdndActionList, XdndActionDescription, XdndLeave, XdndStatus, XdndDrop,
+	    XdndSelection, XDND_DATA, XDND_PREFETCH, XdndTypeList, XdndFinished, WM_PROTOCOLS, WM_DELETE_WINDOW, INCR,
+	    typesWeAccept[8];
+
+// Names of the above atoms, so they can be interned in one go and recorded in traces
+static const struct {
+	const char *name;
+	Atom *atom;
+} atomTable[] = {
+	{ "XdndAware", &XdndAware },
+	{ "XdndEnter", &XdndEnter },
+	{ "XdndPosition", &XdndPosition },
+	{ "XdndActionCopy", &XdndActionCopy },
+	{ "XdndActionMove", &XdndActionMove },
+	{ "XdndActionLink", &XdndActionLink },
+	{ "XdndActionAsk", &XdndActionAsk },
+	{ "XdndActionList", &XdndActionList },
+	{ "XdndActionDescription", &XdndActionDescription },
+	{ "XdndLeave", &XdndLeave },
+	{ "XdndStatus", &XdndStatus },
+	{ "XdndDrop", &XdndDrop },
+	{ "XdndSelection", &XdndSelection },
+	{ "XDND_DATA", &XDND_DATA },
+	{ "XDND_PREFETCH", &XDND_PREFETCH },
+	{ "XdndTypeList", &XdndTypeList },
+	{ "XdndFinished", &XdndFinished },
+	{ "WM_PROTOCOLS", &WM_PROTOCOLS },
+	{ "WM_DELETE_WINDOW", &WM_DELETE_WINDOW },
+	{ "INCR", &INCR },
+	// Type atoms we will accept for file drop
+	{ "text/uri-list", &typesWeAccept[0] },
+	{ "UTF8_STRING", &typesWeAccept[1] },
+	{ "TEXT", &typesWeAccept[2] },
+	{ "STRING", &typesWeAccept[3] },
+	{ "text/plain;charset=utf-8", &typesWeAccept[4] },
+	{ "text/plain", &typesWeAccept[5] },
+	// Streamed rather than dropped as a file
+	{ "audio/midi", &typesWeAccept[MIDI_TYPE] },
+	{ "application/x-zstd-chunks;type=audio/midi", &typesWeAccept[MIDI_ZSTD_TYPE] }
+};
+#define NUMBER_OF_ATOMS (sizeof(atomTable) / sizeof(atomTable[0]))
+
+// Action atoms for each drag action the modifiers can pick
+static Atom *dragActionAtoms[NumberOfDragActions] = {
+	[DragCopy] = &XdndActionCopy,
+	[DragMove] = &XdndActionMove,
+	[DragLink] = &XdndActionLink,
+	[DragAsk] = &XdndActionAsk
+};
+
+// Actions we offer as a source when asked, best first, and how to describe them
+static const DragAction offeredActions[] = { DragMove, DragCopy, DragLink };
+#define NUMBER_OF_OFFERED_ACTIONS (sizeof(offeredActions) / sizeof(offeredActions[0]))
+static const char offeredActionDescriptions[] = "Move the square\0Copy the square\0Link to the square";
+
+// Client message atoms we dispatch on, mapped to their dense message IDs. This is filled
+// in once the atoms are known, and looked up with open addressing
+#define MESSAGE_LOOKUP_SIZE 16
+static const struct {
+	Atom *atom;
+	XdndMessage message;
+} messageAtoms[] = {
+	{ &XdndEnter, MessageEnter },
+	{ &XdndPosition, MessagePosition },
+	{ &XdndLeave, MessageLeave },
+	{ &XdndStatus, MessageStatus },
+	{ &XdndDrop, MessageDrop },
+	{ &XdndFinished, MessageFinished },
+	{ &WM_PROTOCOLS, MessageWmProtocols }
+};
+static Atom messageLookupKeys[MESSAGE_LOOKUP_SIZE];
+static XdndMessage messageLookupIds[MESSAGE_LOOKUP_SIZE];
+
+// Sessions for every exchange in progress, shared by all of our windows
+static XdndSessionTable xdndSessions;
+
+// This stops streaming MIDI to a target, and stops watching its window if still doing so
+static void stopMidiSend(WindowContext *ctx)
+{
+	if (ctx->midiSender.active) {
+		beginPeerRequests(ctx->disp, ctx->midiSender.requestor);
+		XSelectInput(ctx->disp, ctx->midiSender.requestor, NoEventMask);
+		endPeerRequests(ctx->disp);
+	}
+	ctx->midiSender.active = false;
+	ctx->midiSender.requestor = None;
+}
+
+// This forgets the drag whose data was being fetched ahead of its drop
+static void clearPrefetch(DropPrefetch *prefetch)
+{
+	prefetch->phase = PrefetchIdle;
+	prefetch->peer = None;
+	free(prefetch->pathStr);
+	prefetch->pathStr = NULL;
+	free(prefetch->content);
+	prefetch->content = NULL;
+}
+
+// This throws away whatever has been fetched for a drag that won't be dropped on us. A load
+// still running can't be stopped, so it is thrown away once it finishes, and a conversion
+// still waiting for SelectionNotify has its answer deleted when it comes
+static void discardPrefetch(WindowContext *ctx)
+{
+	if (ctx->prefetch.phase == PrefetchIdle)
+		return;
+	ctx->prefetch.discarded++;
+	clearPrefetch(&ctx->prefetch);
+}
+
+// This finds the drag a pointer has in our window, setting one up the first time the
+// pointer is seen. With every slot taken, one whose pointer is doing nothing is reused -
+// failing that, the pointer can't drag
+static PointerDrag *getPointerDrag(WindowContext *ctx, int device)
+{
+	PointerDrag *idle = NULL;
+
+	for (int i = 0; i < MAX_POINTER_DRAGS; ++i) {
+		PointerDrag *drag = &ctx->drags[i];
+		if (drag->inUse && drag->device == device)
+			return drag;
+		if (!idle && (!drag->inUse || (drag != ctx->holder && !drag->session)))
+			idle = drag;
+	}
+	if (idle) {
+		memset(idle, 0, sizeof(*idle));
+		idle->inUse = true;
+		idle->device = device;
+	}
+
+	return idle;
+}
+
+// This finds the pointer whose drag an exchange we are the source of belongs to
+static PointerDrag *findSessionDrag(WindowContext *ctx, XdndSession *session)
+{
+	for (int i = 0; i < MAX_POINTER_DRAGS; ++i) {
+		if (ctx->drags[i].inUse && ctx->drags[i].session == session)
+			return &ctx->drags[i];
+	}
+
+	return NULL;
+}
+
+// This ends an exchange - the session is released, and any timeout, transfer or window
+// state pointing at it is cleared
+static void endXdndSession(WindowContext *ctx, XdndSession *session)
+{
+	Window peer = session->peer;
+
+	disarmXdndTimer(&ctx->timer, session);
+	if (session->role == RoleSource) {
+		PointerDrag *drag = findSessionDrag(ctx, session);
+		if (drag) {
+			drag->session = NULL;
+			drag->positionsTimed = 0;
+			drag->positionsAwaiting = 0;
+			drag->positionMoved = false;
+		}
+		if (ctx->midiSender.requestor == peer)
+			stopMidiSend(ctx);
+		if (ctx->payloadTakenBy == peer)
+			ctx->payloadTakenBy = None;
+	} else {
+		if (ctx->droppingPeer == peer) {
+			ctx->droppingPeer = None;
+			ctx->midiReceiver.active = false;
+		}
+		if (ctx->prefetch.peer == peer)
+			discardPrefetch(ctx);
+	}
+	releaseXdndSession(&xdndSessions, session);
+}
+
+// This starts a timeout for a phase of an exchange, replacing any it was already waiting on
+static void armSessionTimer(WindowContext *ctx, XdndSession *session, XdndTimeoutKind kind)
+{
+	armXdndTimer(&ctx->timer, session, kind, ctx->options->timeoutMs);
+}
+
+// This cancels the timeout for an exchange, if it has one
+static void disarmSessionTimer(WindowContext *ctx, XdndSession *session)
+{
+	disarmXdndTimer(&ctx->timer, session);
+}
+
+// This sets the colour the square is drawn in
+static void setForeground(WindowContext *ctx, unsigned long pixel)
+{
+	ctx->foreground = pixel;
+}
+
+// This draws the square inside the window, after clearing its contents. With a render
+// thread, the scene is handed over and drawn there, so we go straight back to the protocol
+static void drawSquare(WindowContext *ctx)
+{
+	Square *square = &ctx->square;
+	SceneState scene = {
+		.x = square->x,
+		.y = square->y,
+		.size = square->size,
+		.visible = square->visible,
+		.pending = square->pending,
+		.foreground = ctx->foreground,
+		.background = ctx->white
+	};
+
+	if (ctx->renderThread) {
+		publishScene(ctx->renderThread, &scene);
+		return;
+	}
+	drawScene(ctx->disp, ctx->wind, ctx->gContext, ctx->renderer, &scene,
+		ctx->options->scenePasses);
+}
+
+// This keeps the square inside the window
+static void clampSquare(WindowContext *ctx)
+{
+	int limit = ctx->options->windowSize - ctx->square.size;
+
+	if (ctx->square.x < 0)
+		ctx->square.x = 0;
+	if (ctx->square.y < 0)
+		ctx->square.y = 0;
+	if (ctx->square.x > limit)
+		ctx->square.x = limit;
+	if (ctx->square.y > limit)
+		ctx->square.y = limit;
+}
+
+// This tells us if the pointer is inside the square, using coordinates relative
+// to the host window
+static bool isPointerInsideSquare(int x, int y, Square *square)
+{
+	return x >= square->x && x < square->x + square->size &&
+		y >= square->y && y < square->y + square->size;
+}
+
+// This somewhat naively calculates what window we are over by drilling down
+// to its children and so on using recursion, skipping over our own drag icon
+static Window getWindowPointerIsOver(Display *disp, Window startingWindow, Window dragIcon,
+	int p_rootX, int p_rootY, int originX, int originY)
+{
+	// Window we are returning
+	Window returnWindow = None;
+
+	// Get stacked list of children in stacked order
+	Window rootReturn, parentReturn, childReturn, *childList;
+	unsigned int numOfChildren;
+	if (XQueryTree(disp, startingWindow, &rootReturn, &parentReturn,
+		&childList, &numOfChildren) != 0) {
+		// Search through children
+		for (int i = numOfChildren - 1; i >= 0; --i) {
+			// The icon is always under the pointer, but is never the target
+			if (childList[i] == dragIcon)
+				continue;
+
+			// Get window attributes
+			XWindowAttributes childAttrs;
+			XGetWindowAttributes(disp, childList[i], &childAttrs);
+
+			// Check if cursor is in this window
+			if (p_rootX >= originX + childAttrs.x &&
+				p_rootX < originX + childAttrs.x + childAttrs.width &&
+				p_rootY >= originY + childAttrs.y &&
+				p_rootY < originY + childAttrs.y + childAttrs.height) {
+				returnWindow = getWindowPointerIsOver(disp, childList[i], dragIcon,
+					p_rootX, p_rootY, originX + childAttrs.x, originY + childAttrs.y);
+				break;
+			}
+		}
+		XFree(childList);
+	}
+
+	// We are are bottom of recursion stack, set correct window to be returned up through each level
+	if (returnWindow == None)
+		returnWindow = startingWindow;
+
+	return returnWindow;
+}
+
+// This checks if the supplied window has the XdndAware property
+static int hasCorrectXdndAwareProperty(Display *disp, Window wind) {
+	// Try to get property
+	int retVal = 0;
+	Atom actualType = None;
+	int actualFormat;
+	unsigned long numOfItems, bytesAfterReturn;
+	unsigned char *data = NULL;
+	if (XGetWindowProperty(disp, wind, XdndAware, 0, 1024, False, AnyPropertyType,
+		&actualType, &actualFormat, &numOfItems, &bytesAfterReturn, &data) == Success) {
+		if (actualType != None) {
+			// Assume architecture is little endian and just read first byte for
+			// XDND protocol version
+			if (data[0] <= XDND_PROTOCOL_VERSION) {
+				retVal = data[0];
+			}
+
+			XFree(data);
+		}
+	}
+
+	return retVal;
+}
+
+// This function prints the contents of ClientMessage events
+static void printClientMessage(Display *disp, XClientMessageEvent *message)
+{
+	// Get atom type as string
+	char *messageTypeStr = XGetAtomName(disp, message->message_type);
+	printf("Message type: %s\n", messageTypeStr);
+	XFree(messageTypeStr);
+
+	// Handle format
+	printf("Message word size: %d bits\n", message->format);
+	printf("Message ");
+	switch (message->format) {
+	case 8:
+		printf("bytes: ");
+		for (int i = 0; i < 20; ++i)
+			printf("%d ", message->data.b[i]);
+		break;
+	case 16:
+		printf("16-bit shorts: ");
+		for (int i = 0; i < 10; ++i)
+			printf("%d ", message->data.s[i]);
+		break;
+	case 32:
+		printf("32-bit longs: ");
+		for (int i = 0; i < 5; ++i)
+			printf("%d ", (int32_t)message->data.l[i]);
+		break;
+	}
+	printf("\n");
+}
+
+// This sends the XdndEnter message which initiates the XDND protocol exchange. The first
+// three types go in the message, and if there are more, all of them go in XdndTypeList -
+// typed ATOM, as targets in other toolkits won't read it otherwise
+void sendXdndEnter(Display *disp, int xdndVersion, Window source, XdndSession *session,
+	const Atom *types, int numberOfTypes)
+{
+	Window target = session->peer;
+
+	// Only send if we are not already in an exchange
+	if (session->phase == PhaseIdle) {
+		// Declare message struct and populate its values
+		XEvent message;
+		memset(&message, 0, sizeof(message));
+		message.xclient.type = ClientMessage;
+		message.xclient.display = disp;
+		message.xclient.window = target;
+		message.xclient.message_type = XdndEnter;
+		message.xclient.format = 32;
+		message.xclient.data.l[0] = source;
+		message.xclient.data.l[1] = xdndVersion << 24;
+		for (int i = 0; i < 3; ++i)
+			message.xclient.data.l[2 + i] = i < numberOfTypes ? types[i] : None;
+		if (numberOfTypes > 3) {
+			XChangeProperty(disp, source, XdndTypeList, XA_ATOM, 32, PropModeReplace,
+				(const unsigned char *)types, numberOfTypes);
+			message.xclient.data.l[1] |= 1;
+		}
+
+		// Send it to target window
+		beginPeerRequests(disp, target);
+		if (XSendEvent(disp, target, False, 0, &message) == 0)
+			philError("XSendEvent");
+		endPeerRequests(disp);
+	}
+}
+
+// This sends the XdndPosition messages, which update the target on the state of the cursor
+// and selected action
+void sendXdndPosition(Display *disp, Window source, XdndSession *session, int time, int p_rootX, int p_rootY,
+	Atom action)
+{
+	Window target = session->peer;
+
+	if (session->role == RoleSource) {
+		// Declare message struct and populate its values
+		XEvent message;
+		memset(&message, 0, sizeof(message));
+		message.xclient.type = ClientMessage;
+		message.xclient.display = disp;
+		message.xclient.window = target;
+		message.xclient.message_type = XdndPosition;
+		message.xclient.format = 32;
+		message.xclient.data.l[0] = source;
+		//message.xclient.data.l[1] reserved
+		message.xclient.data.l[2] = p_rootX << 16 | p_rootY;
+		message.xclient.data.l[3] = time;
+		message.xclient.data.l[4] = action;
+		session->lastPositionTimestamp = time;
+
+		// Send it to target window
+		beginPeerRequests(disp, target);
+		if (XSendEvent(disp, target, False, 0, &message) == 0)
+			philError("XSendEvent");
+		endPeerRequests(disp);
+	}
+}
+
+// This is sent by the source when the exchange is abandoned
+void sendXdndLeave(Display *disp, Window source, XdndSession *session)
+{
+	Window target = session->peer;
+
+	if (session->role == RoleSource) {
+		// Declare message struct and populate its values
+		XEvent message;
+		memset(&message, 0, sizeof(message));
+		message.xclient.type = ClientMessage;
+		message.xclient.display = disp;
+		message.xclient.window = target;
+		message.xclient.message_type = XdndLeave;
+		message.xclient.format = 32;
+		message.xclient.data.l[0] = source;
+		// Rest of array members reserved so not set
+
+		// Send it to target window
+		beginPeerRequests(disp, target);
+		if (XSendEvent(disp, target, False, 0, &message) == 0)
+			philError("XSendEvent");
+		endPeerRequests(disp);
+	}
+}
+
+// This is sent by the target when the exchange has completed, or been abandoned
+static void sendXdndFinished(Display *disp, Window source, XdndSession *session, bool accepted)
+{
+	Window target = session->peer;
+
+	if (session->role == RoleTarget) {
+		// Declare message struct and populate its values
+		XEvent message;
+		memset(&message, 0, sizeof(message));
+		message.xclient.type = ClientMessage;
+		message.xclient.display = disp;
+		message.xclient.window = target;
+		message.xclient.message_type = XdndFinished;
+		message.xclient.format = 32;
+		message.xclient.data.l[0] = source;
+		message.xclient.data.l[1] = accepted ? 1 : 0;
+		message.xclient.data.l[2] = accepted ? session->acceptedAction : None;
+
+		// Send it to target window
+		beginPeerRequests(disp, target);
+		if (XSendEvent(disp, target, False, 0, &message) == 0)
+			philError("XSendEvent");
+		endPeerRequests(disp);
+	}
+}
+
+// This is sent by the target to the source to say whether or not it will accept the drop
+static void sendXdndStatus(Display *disp, Window source, XdndSession *session, Atom action)
+{
+	Window target = session->peer;
+
+	if (session->role == RoleTarget) {
+		// Declare message struct and populate its values
+		XEvent message;
+		memset(&message, 0, sizeof(message));
+		message.xclient.type = ClientMessage;
+		message.xclient.display = disp;
+		message.xclient.window = target;
+		message.xclient.message_type = XdndStatus;
+		message.xclient.format = 32;
+		message.xclient.data.l[0] = source;
+		message.xclient.data.l[1] = 1; // Sets accept and want position flags
+
+		// Send back window rectangle coordinates and width
+		message.xclient.data.l[2] = 0;
+		message.xclient.data.l[3] = 0;
+
+		// Specify action we accept
+		message.xclient.data.l[4] = action;
+
+		// Send it to target window
+		beginPeerRequests(disp, target);
+		if (XSendEvent(disp, target, False, 0, &message) == 0)
+			philError("XSendEvent");
+		endPeerRequests(disp);
+	}
+}
+
+// This is sent by the source to the target to say it can call XConvertSelection
+void sendXdndDrop(Display *disp, Window source, XdndSession *session)
+{
+	Window target = session->peer;
+
+	if (session->role == RoleSource) {
+		// Declare message struct and populate its values
+		XEvent message;
+		memset(&message, 0, sizeof(message));
+		message.xclient.type = ClientMessage;
+		message.xclient.display = disp;
+		message.xclient.window = target;
+		message.xclient.message_type = XdndDrop;
+		message.xclient.format = 32;
+		message.xclient.data.l[0] = source;
+		//message.xclient.data.l[1] reserved
+		message.xclient.data.l[2] = session->lastPositionTimestamp;
+
+		// Send it to target window
+		beginPeerRequests(disp, target);
+		if (XSendEvent(disp, target, False, 0, &message) == 0)
+			philError("XSendEvent");
+		endPeerRequests(disp);
+	}
+}
+
+// This tells the requestor its property has been set, or for an incremental transfer,
+// that the INCR property announcing it has
+static void notifyRequestor(Display *disp, XSelectionRequestEvent *selectionRequest)
+{
+	// Declare message struct and populate its values
+	XEvent message;
+	memset(&message, 0, sizeof(message));
+	message.xselection.type = SelectionNotify;
+	message.xselection.display = disp;
+	message.xselection.requestor = selectionRequest->requestor;
+	message.xselection.selection = selectionRequest->selection;
+	message.xselection.target = selectionRequest->target;
+	message.xselection.property = selectionRequest->property;
+	message.xselection.time = selectionRequest->time;
+
+	// Send it to target window
+	beginPeerRequests(disp, selectionRequest->requestor);
+	if (XSendEvent(disp, selectionRequest->requestor, False, 0, &message) == 0)
+		philError("XSendEvent");
+	endPeerRequests(disp);
+}
+
+// This tells a requestor we have nothing for it, by naming no property
+static void refuseSelectionRequest(Display *disp, XSelectionRequestEvent *selectionRequest)
+{
+	XSelectionRequestEvent refusal = *selectionRequest;
+
+	refusal.property = None;
+	notifyRequestor(disp, &refusal);
+}
+
+// This is sent by the source to the target to say the data is ready
+void sendSelectionNotify(Display *disp, XdndSession *session,
+	XSelectionRequestEvent *selectionRequest, const char *pathStr)
+{
+	if (session->role == RoleSource) {
+		// Allocate buffer (two bytes at end for CR/NL and another for null byte)
+		size_t sizeOfPropertyData = strlen("file://") + strlen(pathStr) + 3;
+		char *propertyData = malloc(sizeOfPropertyData);
+		if (!propertyData)
+			philError("malloc");
+
+		// Copy data to buffer
+		strcpy(propertyData, "file://");
+		strcat(propertyData, pathStr);
+		propertyData[sizeOfPropertyData-3] = 0xD;
+		propertyData[sizeOfPropertyData-2] = 0xA;
+		propertyData[sizeOfPropertyData-1] = '\0';
+
+		// Set property on target window - do not copy end null byte
+		beginPeerRequests(disp, selectionRequest->requestor);
+		XChangeProperty(disp, selectionRequest->requestor, selectionRequest->property,
+			typesWeAccept[0], 8, PropModeReplace, (unsigned char *)propertyData, sizeOfPropertyData-1);
+		endPeerRequests(disp);
+
+		// Free property buffer
+		free(propertyData);
+
+		notifyRequestor(disp, selectionRequest);
+	}
+}
+
+// This finds the drag action for an action atom, or NumberOfDragActions if we don't know it
+static DragAction getDragActionForAtom(Atom action)
+{
+	for (int i = 0; i < NumberOfDragActions; ++i) {
+		if (*dragActionAtoms[i] == action)
+			return i;
+	}
+	return NumberOfDragActions;
+}
+
+// Test whether the supplied atom is in our types list - compressed types only count when
+// this build can decompress them
+static bool doWeAcceptAtom(Atom a)
+{
+	if (a == typesWeAccept[MIDI_ZSTD_TYPE] && !isChunkCompressionAvailable())
+		return false;
+
+	for (int i = 0; i < sizeof(typesWeAccept) / sizeof(Atom); ++i) {
+		if (a == typesWeAccept[i]) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// This gets the XdndTypeList from the source window when we need it, returning how many of
+// its types fit in the supplied array
+static int getOfferedTypes(Display *disp, Window source, Atom *types, int maxTypes)
+{
+	// Try to get XdndTypeList property
+	int retVal = 0;
+	Atom actualType = None;
+	int actualFormat;
+	unsigned long numOfItems, bytesAfterReturn;
+	unsigned char *data = NULL;
+	beginPeerRequests(disp, source);
+	int status = XGetWindowProperty(disp, source, XdndTypeList, 0, 1024, False, XA_ATOM,
+		&actualType, &actualFormat, &numOfItems, &bytesAfterReturn, &data);
+	endPeerRequests(disp);
+	if (status == Success) {
+		// Read it as other toolkits do, so a list we couldn't send them is no use to us either
+		if (actualType == XA_ATOM && actualFormat == 32) {
+			Atom *offeredAtoms = (Atom *)data;
+			for (int i = 0; i < numOfItems && retVal < maxTypes; ++i)
+				types[retVal++] = offeredAtoms[i];
+		}
+		if (data)
+			XFree(data);
+	}
+
+	return retVal;
+}
+
+// Read copied path string from our window property
+static char *getCopiedData(Display *disp, Window source, Atom property)
+{
+	// Declare return value
+	char *retVal = NULL;
+
+	// Try to get PRIMARY property
+	Atom actualType = None;
+	int actualFormat;
+	unsigned long numOfItems, bytesAfterReturn;
+	unsigned char *data = NULL;
+	if (XGetWindowProperty(disp, source, property, 0, 1024, False, AnyPropertyType,
+		&actualType, &actualFormat, &numOfItems, &bytesAfterReturn, &data) == Success) {
+		// Allocate temporary buffer
+		char *tempBuffer = malloc(numOfItems + 1);
+		if (!tempBuffer)
+			philError("malloc");
+
+		// Copy all data from X buffer then add null-byte to create proper string, then
+		// dispose of X buffer
+		memcpy(tempBuffer, data, numOfItems);
+		tempBuffer[numOfItems] = '\0';
+		XFree(data);
+
+		// Copy from beyond 'file://' prefix if present
+		char *tempPtr;
+		if ((tempPtr = strstr(tempBuffer, "file://")) != NULL) {
+			tempPtr = tempBuffer + 7;
+		} else {
+			tempPtr = tempBuffer;
+		}
+
+		// Check if cr/nl ending is present and terminate string
+		// before this if so
+		if (tempPtr[strlen(tempPtr)-2] == 0xD && tempPtr[strlen(tempPtr)-1] == 0xA)
+			tempPtr[strlen(tempPtr)-2] = '\0';
+
+		// Allocate return buffer
+		retVal = malloc(strlen(tempPtr) + 1);
+		if (!retVal)
+			philError("malloc");
+
+		// Copy data from temp buffer to it, then free temp buffer
+		memcpy(retVal, tempPtr, strlen(tempPtr));
+		retVal[strlen(tempPtr)] = '\0';
+		free(tempBuffer);
+	}
+
+	// Return malloc allocated buffer - caller must free
+	return retVal;
+}
+
+// This gives the milliseconds since the given time on the monotonic clock
+static double getElapsedMs(const struct timespec *since)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - since->tv_sec) * 1e3 + (now.tv_nsec - since->tv_nsec) / 1e6;
+}
+
+// This starts streaming the square to the target as a MIDI file. It always goes in chunks,
+// however small - the INCR property tells the target a transfer is coming, and each chunk
+// is only produced once the target has deleted the one before, so the file never exists
+// in full on our side
+static void startMidiSend(WindowContext *ctx, XSelectionRequestEvent *selectionRequest)
+{
+	MidiSender *sender = &ctx->midiSender;
+	unsigned long notes = (unsigned long)ctx->options->midiMegabytes * 1024 * 1024 / 4;
+
+	// Only one target can be converting XdndSelection at a time
+	stopMidiSend(ctx);
+	initMidiProducer(&sender->producer, ctx->square.colour, notes);
+	sender->requestor = selectionRequest->requestor;
+	sender->property = selectionRequest->property;
+	sender->type = selectionRequest->target;
+	sender->compressed = sender->type == typesWeAccept[MIDI_ZSTD_TYPE];
+	sender->chunks = 0;
+	sender->wireBytes = 0;
+	sender->active = true;
+
+	// Watch for the target deleting each chunk, then announce the transfer with its size
+	beginPeerRequests(ctx->disp, sender->requestor);
+	XSelectInput(ctx->disp, sender->requestor, PropertyChangeMask);
+	long size = sender->producer.totalBytes;
+	XChangeProperty(ctx->disp, sender->requestor, sender->property, INCR, 32, PropModeReplace,
+		(unsigned char *)&size, 1);
+	endPeerRequests(ctx->disp);
+	notifyRequestor(ctx->disp, selectionRequest);
+	printf("%s: streaming %zu bytes of MIDI in chunks of up to %zu bytes%s\n", ctx->procStr,
+		sender->producer.totalBytes, sender->chunkBytes,
+		sender->compressed ? ", compressed where it pays" : "");
+}
+
+// This puts the next chunk on the target's window once it has taken the last one - the
+// empty chunk after the end of the file tells it there is no more. Compressed chunks are
+// encoded as they are produced, so the chunk on the wire never waits for the rest
+static void sendMidiChunk(WindowContext *ctx)
+{
+	MidiSender *sender = &ctx->midiSender;
+	size_t length, wireLength;
+	unsigned char *wire;
+
+	if (sender->compressed) {
+		length = produceMidiChunk(&sender->producer, sender->chunk,
+			sender->chunkBytes - CHUNK_HEADER_BYTES);
+		wire = sender->encoded;
+		wireLength = length > 0 ? encodeChunk(&sender->codec, sender->chunk, length, wire) : 0;
+	} else {
+		length = produceMidiChunk(&sender->producer, sender->chunk, sender->chunkBytes);
+		wire = sender->chunk;
+		wireLength = length;
+	}
+
+	beginPeerRequests(ctx->disp, sender->requestor);
+	XChangeProperty(ctx->disp, sender->requestor, sender->property, sender->type, 8,
+		PropModeReplace, wire, wireLength);
+	endPeerRequests(ctx->disp);
+	sender->wireBytes += wireLength;
+	if (length > 0) {
+		sender->chunks++;
+		return;
+	}
+
+	printf("%s: streamed %zu bytes of MIDI in %lu chunks, %zu bytes on the wire (%.1f%%)\n",
+		ctx->procStr, sender->producer.totalBytes, sender->chunks, sender->wireBytes,
+		100.0 * sender->wireBytes / sender->producer.totalBytes);
+	stopMidiSend(ctx);
+}
+
+// This reads whatever MIDI the source has put on our window and parses it, deleting the
+// property in the same request so the source can go straight on to the next chunk. The
+// square takes its colour from the first program change, without waiting for the rest
+static Atom readMidiChunk(WindowContext *ctx, unsigned long *lengthReturn)
+{
+	MidiReceiver *receiver = &ctx->midiReceiver;
+	Atom actualType = None;
+	int actualFormat;
+	unsigned long bytesAfterReturn;
+	unsigned char *data = NULL;
+
+	*lengthReturn = 0;
+	if (XGetWindowProperty(ctx->disp, ctx->wind, XDND_DATA, 0, 0x1FFFFFFF, True, AnyPropertyType,
+		&actualType, &actualFormat, lengthReturn, &bytesAfterReturn, &data) != Success)
+		return None;
+
+	// Compressed chunks are decoded on their own, as soon as each arrives. The size one
+	// decodes to is the peer's say-so, so one claiming too much is a parse error, not an
+	// allocation
+	unsigned char *midi = data;
+	size_t midiLength = *lengthReturn;
+	if (actualType == typesWeAccept[MIDI_ZSTD_TYPE] && actualFormat == 8 && *lengthReturn > 0) {
+		size_t decodedSize = getDecodedChunkSize(data, *lengthReturn);
+		if (decodedSize > receiver->decodedCapacity) {
+			free(receiver->decoded);
+			receiver->decoded = malloc(decodedSize);
+			if (!receiver->decoded)
+				philError("malloc");
+			receiver->decodedCapacity = decodedSize;
+		}
+		midi = receiver->decoded;
+		if (decodedSize == 0 || !decodeChunk(&receiver->codec, data, *lengthReturn, midi,
+			receiver->decodedCapacity, &midiLength)) {
+			printf("%s: could not decode a compressed MIDI chunk\n", ctx->procStr);
+			receiver->parser.state = ParseError;
+			midiLength = 0;
+		}
+	}
+
+	if ((actualType == typesWeAccept[MIDI_TYPE] || actualType == typesWeAccept[MIDI_ZSTD_TYPE]) &&
+		actualFormat == 8 && *lengthReturn > 0) {
+		feedMidiParser(&receiver->parser, midi, midiLength);
+		receiver->wireBytes += *lengthReturn;
+		receiver->chunks++;
+		if (receiver->firstEventMs < 0 && receiver->parser.events > 0) {
+			receiver->firstEventMs = getElapsedMs(&receiver->dropReceivedAt);
+			printf("%s: first MIDI event %.3f ms after XdndDrop\n", ctx->procStr,
+				receiver->firstEventMs);
+		}
+		if (ctx->square.pending && receiver->parser.program >= 0) {
+			ctx->square.colour = receiver->parser.program == BlueSquare ? BlueSquare : RedSquare;
+			ctx->square.pending = false;
+			setForeground(ctx, ctx->square.colour == RedSquare ? ctx->red : ctx->blue);
+			drawSquare(ctx);
+		}
+	}
+	if (data)
+		XFree(data);
+
+	return actualType;
+}
+
+// This reports on a MIDI drop once all of it is in, and finishes the exchange
+static void endMidiReceive(WindowContext *ctx, XdndSession *session)
+{
+	MidiReceiver *receiver = &ctx->midiReceiver;
+	MidiParser *parser = &receiver->parser;
+	double totalMs = getElapsedMs(&receiver->dropReceivedAt);
+	bool complete = parser->state == ParseComplete;
+
+	receiver->active = false;
+	printf("%s: parsed %lu MIDI events from %zu bytes (%zu on the wire) in %lu chunks - first "
+		"event after %.3f ms, all in %.3f ms (%.1f MB/s)%s\n", ctx->procStr, parser->events,
+		parser->bytes, receiver->wireBytes, receiver->chunks, receiver->firstEventMs, totalMs,
+		parser->bytes / 1048576.0 / (totalMs / 1e3), complete ? "" : " - the file was cut short");
+	if (ctx->square.pending) {
+		ctx->square.pending = false;
+		setForeground(ctx, ctx->square.colour == RedSquare ? ctx->red : ctx->blue);
+	}
+
+	if (session) {
+		printf("%s: sending XdndFinished\n", ctx->procStr);
+		sendXdndFinished(ctx->disp, ctx->wind, session, complete);
+		endXdndSession(ctx, session);
+	}
+	drawSquare(ctx);
+}
+
+// This starts taking a MIDI drop. Deleting the INCR property as we read it asks the source
+// for the first chunk - a source that sent the whole file at once is already done
+static void startMidiReceive(WindowContext *ctx, XdndSession *session)
+{
+	MidiReceiver *receiver = &ctx->midiReceiver;
+	unsigned long length;
+
+	initMidiParser(&receiver->parser);
+	receiver->firstEventMs = -1;
+	receiver->chunks = 0;
+	receiver->wireBytes = 0;
+	if (readMidiChunk(ctx, &length) == INCR) {
+		receiver->active = true;
+		if (session)
+			armSessionTimer(ctx, session, SelectionNotifyTimeout);
+		return;
+	}
+	endMidiReceive(ctx, session);
+}
+
+// This takes the next chunk of a MIDI drop, restarting the timeout while they keep coming
+static void handleMidiChunk(WindowContext *ctx)
+{
+	XdndSession *session = findXdndSession(&xdndSessions, ctx->droppingPeer, RoleTarget);
+	unsigned long length;
+
+	readMidiChunk(ctx, &length);
+	if (length > 0) {
+		if (session)
+			armSessionTimer(ctx, session, SelectionNotifyTimeout);
+		return;
+	}
+	endMidiReceive(ctx, session);
+}
+
+// This handles messages we don't dispatch on, by printing them
+static void handleOtherMessage(WindowContext *ctx, XdndSession *session, XClientMessageEvent *message)
+{
+	printf("%s: received ClientMessage message\n", ctx->procStr);
+	printClientMessage(ctx->disp, message);
+}
+
+// This checks if we are being closed
+static void handleWmProtocols(WindowContext *ctx, XdndSession *session, XClientMessageEvent *message)
+{
+	if (message->data.l[0] == WM_DELETE_WINDOW) {
+		// End event loop
+		ctx->continueEventLoop = false;
+	}
+}
+
+// This finds the content hash among the types a source offers, if it offers one. One we
+// hold is recognised from its atom alone - otherwise the other types have to be named,
+// so we know what to keep once it is dropped
+static Atom findContentType(WindowContext *ctx, Atom *offered, int numberOffered)
+{
+	Atom retVal = None;
+	Atom unknown[MAX_OFFERED_TYPES];
+	char *names[MAX_OFFERED_TYPES];
+	int numberUnknown = 0;
+
+	if (ctx->cache.budgetBytes == 0)
+		return None;
+	for (int i = 0; i < numberOffered; ++i) {
+		if (doWeAcceptAtom(offered[i]))
+			continue;
+		if (isContentCached(&ctx->cache, offered[i]))
+			return offered[i];
+		unknown[numberUnknown++] = offered[i];
+	}
+
+	if (numberUnknown == 0 || !XGetAtomNames(ctx->disp, unknown, numberUnknown, names))
+		return None;
+	for (int i = 0; i < numberUnknown; ++i) {
+		if (retVal == None && strncmp(names[i], CONTENT_TYPE_PREFIX,
+			strlen(CONTENT_TYPE_PREFIX)) == 0)
+			retVal = unknown[i];
+		XFree(names[i]);
+	}
+
+	return retVal;
+}
+
+// This names the square we are about to drag with a type carrying a hash of its content,
+// so a target already holding that content can skip the transfer. Hashing reads through
+// the whole payload, and the payload only varies with the colour here, so each colour is
+// hashed and its atom interned just the once - bar colours dropped on us from elsewhere
+// that we don't know, which are hashed every time
+static Atom getContentType(WindowContext *ctx)
+{
+	Atom uncachedType = None;
+	Atom *contentType = &uncachedType;
+
+	if ((unsigned int)ctx->square.colour < NumberOfSquareColours)
+		contentType = &ctx->contentTypes[ctx->square.colour];
+	if (*contentType == None) {
+		uint64_t hash = getSquareStateHash(&ctx->square, ctx->payload.previewBytes);
+		char name[64];
+		snprintf(name, sizeof(name), CONTENT_TYPE_PREFIX "%016llx", (unsigned long long)hash);
+		*contentType = XInternAtom(ctx->disp, name, False);
+	}
+
+	return *contentType;
+}
+
+// This starts an exchange with us as the target
+static void handleEnter(WindowContext *ctx, XdndSession *session, XClientMessageEvent *message)
+{
+	printf("%s: receiving XdndEnter\n", ctx->procStr);
+
+	// Start a session for the source window
+	session = createXdndSession(&xdndSessions, message->data.l[0], ctx->wind, RoleTarget);
+	if (!session) {
+		printf("%s: too many XDND sessions, ignoring XdndEnter\n", ctx->procStr);
+		return;
+	}
+	session->phase = PhaseNegotiating;
+	session->version = (message->data.l[1] >> 24) & 0x7;
+	session->typeList = message->data.l[1] & 0x1;
+
+	// Collect the types on offer
+	Atom offered[MAX_OFFERED_TYPES];
+	int numberOffered = 0;
+	if (session->typeList) {
+		// More than three types, look in XdndTypeList
+		numberOffered = getOfferedTypes(ctx->disp, session->peer, offered, MAX_OFFERED_TYPES);
+	} else {
+		// Only three types, in the message itself
+		for (int i = 2; i < 5; ++i) {
+			if (message->data.l[i] != None)
+				offered[numberOffered++] = message->data.l[i];
+		}
+	}
+
+	// Determine type to ask for - the first one we support
+	session->proposedType = None;
+	for (int i = 0; i < numberOffered; ++i) {
+		if (doWeAcceptAtom(offered[i])) {
+			session->proposedType = offered[i];
+			break;
+		}
+	}
+	session->contentType = findContentType(ctx, offered, numberOffered);
+}
+
+// This gives up on a pointer's drag, telling the target if there is one, and lets go of the
+// square if the pointer is holding it
+static void cancelDrag(WindowContext *ctx, PointerDrag *drag)
+{
+	XdndSession *session = drag->session;
+
+	// Once the drop has been sent it is up to the target
+	if (session && session->phase == PhaseDropping)
+		return;
+
+	if (session) {
+		printf("%s: sending XdndLeave message to target window 0x%lx as the drag was cancelled\n",
+			ctx->procStr, session->peer);
+		sendXdndLeave(ctx->disp, ctx->wind, session);
+		endXdndSession(ctx, session);
+	}
+	if (ctx->holder == drag) {
+		ctx->holder = NULL;
+		hideDragIcon(&ctx->icon);
+		setForeground(ctx, ctx->square.colour == RedSquare ? ctx->red : ctx->blue);
+		drawSquare(ctx);
+	}
+}
+
+// This tells the target where a pointer is, with the action the held modifiers pick
+static void sendDragPosition(WindowContext *ctx, PointerDrag *drag)
+{
+	XdndSession *session = drag->session;
+	DragAction action = getDragAction(drag->modifierState);
+
+	session->proposedAction = *dragActionAtoms[action];
+	printf("%s: sending XdndPosition to target window 0x%lx\n", ctx->procStr, session->peer);
+	sendXdndPosition(ctx->disp, ctx->wind, session, drag->time, drag->rootX, drag->rootY,
+		*dragActionAtoms[action]);
+
+	// Only keep the send time while every position before it has one, so that times stay
+	// lined up with the replies
+	if (drag->positionsTimed == drag->positionsAwaiting &&
+		drag->positionsTimed < MAX_TIMED_POSITIONS) {
+		int slot = (drag->oldestPosition + drag->positionsTimed) % MAX_TIMED_POSITIONS;
+		clock_gettime(CLOCK_MONOTONIC, &drag->positionsSentAt[slot]);
+		drag->positionsTimed++;
+	}
+	drag->positionsAwaiting++;
+	drag->positionMoved = false;
+}
+
+// This records the target's answer, and gives up if it won't accept the drop
+static void handleStatus(WindowContext *ctx, XdndSession *session, XClientMessageEvent *message)
+{
+	// Each XdndStatus answers the oldest XdndPosition still waiting, timed if we kept
+	// when that was sent
+	PointerDrag *drag = findSessionDrag(ctx, session);
+	if (drag && drag->positionsAwaiting > 0) {
+		if (drag->positionsTimed > 0) {
+			double latencyMs = getElapsedMs(&drag->positionsSentAt[drag->oldestPosition]);
+			ctx->statusReplies++;
+			ctx->statusLatencyTotalMs += latencyMs;
+			if (latencyMs > ctx->statusLatencyMaxMs)
+				ctx->statusLatencyMaxMs = latencyMs;
+			drag->oldestPosition = (drag->oldestPosition + 1) % MAX_TIMED_POSITIONS;
+			drag->positionsTimed--;
+		}
+		drag->positionsAwaiting--;
+	}
+
+	session->phase = PhaseAccepted;
+	session->acceptedAction = message->data.l[4];
+	disarmSessionTimer(ctx, session);
+
+	// Check if target will accept drop
+	if ((message->data.l[1] & 0x1) != 1) {
+		// Won't accept, break exchange and wipe state
+		printf("%s: sending XdndLeave message to target window "
+			"as it won't accept drop\n", ctx->procStr);
+		sendXdndLeave(ctx->disp, ctx->wind, session);
+		endXdndSession(ctx, session);
+		return;
+	}
+
+	// Tell the target where the pointer got to while it was answering
+	if (drag && drag->positionMoved && drag->positionsAwaiting == 0)
+		sendDragPosition(ctx, drag);
+}
+
+// This completes the exchange on the source side, as the square now lives in the target
+static void handleFinished(WindowContext *ctx, XdndSession *session, XClientMessageEvent *message)
+{
+	printf("%s: receiving XdndFinished message\n", ctx->procStr);
+
+	// Report how long the target took to take the drop from us
+	PointerDrag *drag = findSessionDrag(ctx, session);
+	if (drag) {
+		double latencyMs = getElapsedMs(&drag->dropSentAt);
+		ctx->drops++;
+		ctx->dropLatencyTotalMs += latencyMs;
+		printf("%s: XdndDrop to XdndFinished took %.3f ms (mean %.3f ms over %lu drops)\n",
+			ctx->procStr, latencyMs, ctx->dropLatencyTotalMs / ctx->drops, ctx->drops);
+	}
+
+	// The square only leaves us if the target moved it - a version 5 target says what it
+	// did, and failing that it did what it accepted in XdndStatus, or what we proposed
+	Atom performed = None;
+	if (session->version < 5 || (message->data.l[1] & 0x1)) {
+		if (session->version >= 5 && message->data.l[2] != None)
+			performed = message->data.l[2];
+		else if (session->acceptedAction != None)
+			performed = session->acceptedAction;
+		else
+			performed = session->proposedAction;
+	}
+	if (performed == XdndActionMove) {
+		// The file written for the drag is only the target's if it asked for it - not if
+		// the square was streamed, or the target already held it. Another pointer may have
+		// picked the square up again meanwhile, and its drag goes with it
+		ctx->square.visible = false;
+		if (ctx->payloadTakenBy == session->peer)
+			releasePayload(&ctx->payload);
+		if (ctx->holder)
+			cancelDrag(ctx, ctx->holder);
+	}
+	printf("%s: target %s the square\n", ctx->procStr, performed == None ? "rejected" :
+		getDragActionName(getDragActionForAtom(performed)));
+
+	endXdndSession(ctx, session);
+	drawSquare(ctx);
+}
+
+// This records the pointer position and action from an XdndPosition message
+static void updatePosition(XdndSession *session, XClientMessageEvent *message)
+{
+	session->rootX = message->data.l[2] >> 16;
+	session->rootY = message->data.l[2] & 0xFFFF;
+	session->proposedAction = message->data.l[4];
+	session->lastPositionTimestamp = message->data.l[3];
+}
+
+// This starts fetching the data of a drag we have just accepted, ahead of any drop. A source
+// can be asked to convert the selection at any time, and the answer goes to a property of
+// its own so it can't be taken for a drop's. Only one drag is fetched at a time, and MIDI
+// (which is streamed) and content we already hold are left for the drop
+static void startPrefetch(WindowContext *ctx, XdndSession *session)
+{
+	DropPrefetch *prefetch = &ctx->prefetch;
+
+	if (prefetch->phase != PrefetchIdle || prefetch->converting || ctx->loader.busy ||
+		ctx->droppingPeer != None || session->proposedType == None ||
+		session->proposedType == typesWeAccept[MIDI_TYPE] ||
+		session->proposedType == typesWeAccept[MIDI_ZSTD_TYPE] ||
+		(session->contentType != None && isContentCached(&ctx->cache, session->contentType)))
+		return;
+
+	printf("%s: fetching the data from window 0x%lx ahead of the drop\n", ctx->procStr,
+		session->peer);
+	prefetch->phase = PrefetchConverting;
+	prefetch->peer = session->peer;
+	prefetch->converting = true;
+	XConvertSelection(ctx->disp, XdndSelection, session->proposedType, XDND_PREFETCH,
+		ctx->wind, session->lastPositionTimestamp);
+}
+
+// This answers an XdndPosition with XdndStatus, as every one must be. We can do whatever
+// the source proposes, as long as we know what it is, so a change of action mid-drag is
+// taken up straight away
+static void answerPosition(WindowContext *ctx, XdndSession *session)
+{
+	session->acceptedAction = getDragActionForAtom(session->proposedAction) ==
+		NumberOfDragActions ? XdndActionCopy : session->proposedAction;
+	printf("%s: sending XdndStatus\n", ctx->procStr);
+	sendXdndStatus(ctx->disp, ctx->wind, session, session->acceptedAction);
+}
+
+// This handles the first XdndPosition, which accepts the drag
+static void handleFirstPosition(WindowContext *ctx, XdndSession *session, XClientMessageEvent *message)
+{
+	printf("%s: receiving XdndPosition\n", ctx->procStr);
+
+	// Update state
+	session->phase = PhaseAccepted;
+	updatePosition(session, message);
+	answerPosition(ctx, session);
+	if (ctx->options->prefetchDrops)
+		startPrefetch(ctx, session);
+}
+
+// This handles later XdndPosition messages, which update our state and are answered too
+static void handlePosition(WindowContext *ctx, XdndSession *session, XClientMessageEvent *message)
+{
+	printf("%s: receiving XdndPosition\n", ctx->procStr);
+	updatePosition(session, message);
+	answerPosition(ctx, session);
+}
+
+// This abandons the exchange on the target side
+static void handleLeave(WindowContext *ctx, XdndSession *session, XClientMessageEvent *message)
+{
+	printf("%s: receiving XdndLeave, clearing state\n", ctx->procStr);
+	endXdndSession(ctx, session);
+}
+
+// This picks an action when the source leaves it to us, by reading its XdndActionList
+static DragAction askSourceForAction(WindowContext *ctx, XdndSession *session)
+{
+	DragAction retVal = DragCopy;
+	Atom actualType = None;
+	int actualFormat;
+	unsigned long numOfItems, bytesAfterReturn;
+	unsigned char *data = NULL;
+	beginPeerRequests(ctx->disp, session->peer);
+	int status = XGetWindowProperty(ctx->disp, session->peer, XdndActionList, 0, 1024, False,
+		XA_ATOM, &actualType, &actualFormat, &numOfItems, &bytesAfterReturn, &data);
+	endPeerRequests(ctx->disp);
+	if (status == Success) {
+		// Only a list of atoms will do, as it is for other toolkits
+		if (actualType == XA_ATOM && actualFormat == 32) {
+			Atom *actions = (Atom *)data;
+			for (int i = 0; i < numOfItems; ++i) {
+				DragAction action = getDragActionForAtom(actions[i]);
+				if (action != NumberOfDragActions && action != DragAsk) {
+					retVal = action;
+					break;
+				}
+			}
+		}
+		if (data)
+			XFree(data);
+	}
+
+	return retVal;
+}
+
+// This works out where in our window the drop landed. The last XdndPosition already told
+// us where the pointer was on the root window, so all we need is where our window is, which
+// ConfigureNotify keeps up to date - we only ask the server if that is not known yet
+static void getDropPosition(WindowContext *ctx, XdndSession *session, int *x, int *y)
+{
+	Window childReturn;
+
+	if (!ctx->originKnown) {
+		XTranslateCoordinates(ctx->disp, ctx->wind, DefaultRootWindow(ctx->disp), 0, 0,
+			&ctx->originX, &ctx->originY, &childReturn);
+		ctx->originKnown = true;
+	}
+	*x = session->rootX - ctx->originX;
+	*y = session->rootY - ctx->originY;
+}
+
+// This records how long a drop took to show, from XdndDrop arriving to the square taking on
+// the dropped state
+static void noteDropLanded(WindowContext *ctx, const char *how)
+{
+	double latencyMs = getElapsedMs(&ctx->midiReceiver.dropReceivedAt);
+
+	ctx->dropsLanded++;
+	ctx->landLatencyTotalMs += latencyMs;
+	if (latencyMs > ctx->landLatencyMaxMs)
+		ctx->landLatencyMaxMs = latencyMs;
+	printf("%s: XdndDrop to square shown took %.3f ms%s (mean %.3f ms over %lu drops)\n",
+		ctx->procStr, latencyMs, how, ctx->landLatencyTotalMs / ctx->dropsLanded,
+		ctx->dropsLanded);
+}
+
+// This collects a load started ahead of a drop, keeping what it read if the drag is still
+// over us. If the source's file couldn't be read, the prefetch is thrown away and a drop
+// already waiting on it fails - returns false if so
+static bool collectPrefetchLoad(WindowContext *ctx)
+{
+	DropPrefetch *prefetch = &ctx->prefetch;
+	size_t size;
+
+	bool loaded = finishDropLoad(&ctx->loader, &prefetch->square);
+	prefetch->loading = false;
+	if (prefetch->phase != PrefetchLoading) {
+		free(takeDropLoadContent(&ctx->loader, &size));
+		return true;
+	}
+	if (!loaded) {
+		printf("%s: could not read the data fetched ahead (%s)\n", ctx->procStr,
+			strerror(ctx->loader.error));
+		XdndSession *dropSession = findXdndSession(&xdndSessions, ctx->droppingPeer, RoleTarget);
+		if (dropSession && dropSession->peer == prefetch->peer) {
+			printf("%s: sending XdndFinished, the drop failed\n", ctx->procStr);
+			sendXdndFinished(ctx->disp, ctx->wind, dropSession, false);
+			endXdndSession(ctx, dropSession);
+		}
+		discardPrefetch(ctx);
+		return false;
+	}
+	prefetch->content = takeDropLoadContent(&ctx->loader, &prefetch->contentSize);
+	prefetch->phase = PrefetchReady;
+
+	// Whatever the last drop left in the kept file has been read already, so remove it now
+	// - the rename a move lands with would otherwise have to free it
+	unlink(ctx->loader.keptPath);
+	return true;
+}
+
+// This keeps whatever payload the last load read whole, under the content type it came with
+static void keepDroppedContent(WindowContext *ctx)
+{
+	size_t size;
+	unsigned char *bytes = takeDropLoadContent(&ctx->loader, &size);
+
+	if (bytes)
+		insertContentCache(&ctx->cache, ctx->loadingContentType, bytes, size);
+}
+
+// This collects the load of a drop's payload, keeping what it read, and returns false if
+// the payload couldn't be taken - the square is left as it was
+static bool collectDropLoad(WindowContext *ctx)
+{
+	if (!finishDropLoad(&ctx->loader, &ctx->square)) {
+		printf("%s: could not take the dropped state (%s)\n", ctx->procStr,
+			strerror(ctx->loader.error));
+		return false;
+	}
+	keepDroppedContent(ctx);
+	setForeground(ctx, ctx->square.colour == RedSquare ? ctx->red : ctx->blue);
+	return true;
+}
+
+// This collects the move that takes over the file of a drop landed from data fetched
+// ahead, and finishes its exchange - the square has shown since the drop, but goes if the
+// file couldn't be taken over after all
+static void collectPrefetchMove(WindowContext *ctx)
+{
+	DropPrefetch *prefetch = &ctx->prefetch;
+
+	bool moved = finishDropLoad(&ctx->loader, NULL);
+	if (moved) {
+		printf("%s: moved %zu bytes of dropped state in %.3f ms\n", ctx->procStr,
+			ctx->loader.transferBytes, ctx->loader.transferNs / 1e6);
+	} else {
+		printf("%s: could not take over the dropped file (%s)\n", ctx->procStr,
+			strerror(ctx->loader.error));
+		ctx->square.visible = false;
+	}
+
+	// The exchange may have been abandoned meanwhile, leaving no one to tell
+	XdndSession *session = findXdndSession(&xdndSessions, prefetch->movingPeer, RoleTarget);
+	prefetch->movingPeer = None;
+	if (session) {
+		printf("%s: sending XdndFinished\n", ctx->procStr);
+		sendXdndFinished(ctx->disp, ctx->wind, session, moved);
+		endXdndSession(ctx, session);
+	}
+	drawSquare(ctx);
+}
+
+// This collects any earlier load still in flight, then shows the square where it was
+// dropped
+static void landDroppedSquare(WindowContext *ctx, XdndSession *session)
+{
+	if (ctx->prefetch.loading)
+		collectPrefetchLoad(ctx);
+	if (ctx->loader.busy && ctx->loader.transferOnly)
+		collectPrefetchMove(ctx);
+	else if (ctx->loader.busy)
+		collectDropLoad(ctx);
+	ctx->square.visible = true;
+
+	// Set new square coordinate origin
+	int dropX, dropY;
+	getDropPosition(ctx, session, &dropX, &dropY);
+	ctx->square.x = dropX - ctx->square.size / 2;
+	ctx->square.y = dropY - ctx->square.size / 2;
+	clampSquare(ctx);
+}
+
+// This takes a drop whose content we already hold from our own copy, without converting
+// the selection, and finishes the exchange straight away
+static void takeCachedDrop(WindowContext *ctx, XdndSession *session, const CachedContent *cached)
+{
+	ContentCache *cache = &ctx->cache;
+
+	printf("%s: already holding the dropped content, skipping a %zu byte transfer "
+		"(hit rate %.1f%% over %lu drops, %zu bytes saved)\n", ctx->procStr, cached->size,
+		100.0 * cache->hits / (cache->hits + cache->misses), cache->hits + cache->misses,
+		cache->bytesSaved);
+	landDroppedSquare(ctx, session);
+	decodeSquareState(cached->bytes, cached->size, &ctx->square);
+	ctx->square.pending = false;
+	setForeground(ctx, ctx->square.colour == RedSquare ? ctx->red : ctx->blue);
+
+	printf("%s: sending XdndFinished\n", ctx->procStr);
+	sendXdndFinished(ctx->disp, ctx->wind, session, true);
+	endXdndSession(ctx, session);
+	noteDropLanded(ctx, " from our own copy");
+	drawSquare(ctx);
+}
+
+// This lands a drop from the data fetched while it hovered. A copy or link needs nothing
+// more, as the state has been read already, but a move still takes the source's file over.
+// That is usually just a rename, but is a copy for files we didn't write or across
+// filesystems, so it happens on the loader and XdndFinished waits for it
+static void commitPrefetch(WindowContext *ctx, XdndSession *session)
+{
+	DropPrefetch *prefetch = &ctx->prefetch;
+	bool moving = session->acceptedAction == XdndActionMove;
+
+	landDroppedSquare(ctx, session);
+	ctx->square.colour = prefetch->square.colour;
+	ctx->square.pending = false;
+	setForeground(ctx, ctx->square.colour == RedSquare ? ctx->red : ctx->blue);
+	if (prefetch->content && session->contentType != None) {
+		insertContentCache(&ctx->cache, session->contentType, prefetch->content,
+			prefetch->contentSize);
+		prefetch->content = NULL;
+	}
+	prefetch->committed++;
+	if (moving) {
+		prefetch->movingPeer = session->peer;
+		startDropTransfer(&ctx->loader, prefetch->pathStr, DragMove);
+		prefetch->pathStr = NULL;
+	}
+	clearPrefetch(prefetch);
+	noteDropLanded(ctx, " with the data fetched ahead");
+
+	if (!moving) {
+		printf("%s: sending XdndFinished\n", ctx->procStr);
+		sendXdndFinished(ctx->disp, ctx->wind, session, true);
+		endXdndSession(ctx, session);
+	}
+	drawSquare(ctx);
+}
+
+// This picks up the answer to a conversion made ahead of a drop, and starts reading the
+// source's file without taking it - the drop says how it is taken. An answer to a prefetch
+// since discarded is just deleted
+static void handlePrefetchNotify(WindowContext *ctx, XSelectionEvent *notify)
+{
+	DropPrefetch *prefetch = &ctx->prefetch;
+	bool current = prefetch->phase == PrefetchConverting;
+	char *pathStr = NULL;
+
+	prefetch->converting = false;
+	if (notify->property == XDND_PREFETCH) {
+		if (current)
+			pathStr = getCopiedData(ctx->disp, ctx->wind, XDND_PREFETCH);
+		XDeleteProperty(ctx->disp, ctx->wind, XDND_PREFETCH);
+	}
+	if (!current)
+		return;
+	if (!pathStr || ctx->loader.busy) {
+		free(pathStr);
+		discardPrefetch(ctx);
+		return;
+	}
+
+	XdndSession *session = findXdndSession(&xdndSessions, prefetch->peer, RoleTarget);
+	prefetch->pathStr = strdup(pathStr);
+	if (!prefetch->pathStr)
+		philError("strdup");
+	prefetch->phase = PrefetchLoading;
+	prefetch->loading = true;
+	startDropLoad(&ctx->loader, pathStr, DragLink, session && session->contentType != None ?
+		ctx->cache.budgetBytes : 0);
+}
+
+// This asks the source for the data once it has been dropped on us
+static void handleDrop(WindowContext *ctx, XdndSession *session, XClientMessageEvent *message)
+{
+	printf("%s: receiving XdndDrop, processing selection\n", ctx->procStr);
+
+	// There is only one XdndSelection, so only one drop can be converted at a time
+	if (ctx->droppingPeer != None) {
+		printf("%s: already converting a drop, rejecting XdndDrop\n", ctx->procStr);
+		sendXdndFinished(ctx->disp, ctx->wind, session, false);
+		endXdndSession(ctx, session);
+		return;
+	}
+
+	// Settle on what the drop does - asking means choosing from the source's list, which
+	// we do by taking the first action it offers that we know
+	DragAction action = getDragActionForAtom(session->proposedAction);
+	if (action == DragAsk)
+		action = askSourceForAction(ctx, session);
+	else if (action == NumberOfDragActions)
+		action = DragCopy;
+	session->acceptedAction = *dragActionAtoms[action];
+	printf("%s: the drop will be %s\n", ctx->procStr, getDragActionName(action));
+	clock_gettime(CLOCK_MONOTONIC, &ctx->midiReceiver.dropReceivedAt);
+
+	// Content we already hold needn't be sent at all
+	if (session->contentType != None) {
+		const CachedContent *cached = lookupContentCache(&ctx->cache, session->contentType);
+		if (cached) {
+			takeCachedDrop(ctx, session, cached);
+			return;
+		}
+	}
+
+	// Update state
+	session->phase = PhaseDropping;
+	session->dropTimestamp = message->data.l[2];
+	ctx->droppingPeer = session->peer;
+
+	// Data fetched while the drag hovered lands now, or as soon as it has been read - a
+	// conversion still on its way is no use, as the drop can't wait on it being refused
+	if (ctx->prefetch.peer == session->peer) {
+		if (ctx->prefetch.phase == PrefetchReady) {
+			commitPrefetch(ctx, session);
+			return;
+		}
+		if (ctx->prefetch.phase == PrefetchLoading)
+			return;
+		discardPrefetch(ctx);
+	}
+
+	// Call XConvertSelection
+	XConvertSelection(ctx->disp, XdndSelection, session->proposedType,
+		XDND_DATA, ctx->wind, session->dropTimestamp);
+	armSessionTimer(ctx, session, SelectionNotifyTimeout);
+}
+
+// Transitions indexed by role, phase and message - anything left out is ignored. Closing
+// the window and printing unknown messages work whatever state we are in
+#define ALWAYS_HANDLED [MessageWmProtocols] = handleWmProtocols, [MessageOther] = handleOtherMessage
+static const XdndTransition transitionTable[NumberOfRoles][NumberOfPhases][NumberOfMessages] = {
+	[RoleNone] = {
+		[PhaseIdle] = { ALWAYS_HANDLED, [MessageEnter] = handleEnter }
+	},
+	[RoleSource] = {
+		[PhaseNegotiating] = { ALWAYS_HANDLED, [MessageStatus] = handleStatus },
+		[PhaseAccepted] = { ALWAYS_HANDLED, [MessageStatus] = handleStatus },
+		[PhaseDropping] = { ALWAYS_HANDLED, [MessageFinished] = handleFinished }
+	},
+	[RoleTarget] = {
+		[PhaseNegotiating] = { ALWAYS_HANDLED, [MessagePosition] = handleFirstPosition,
+			[MessageLeave] = handleLeave },
+		[PhaseAccepted] = { ALWAYS_HANDLED, [MessagePosition] = handlePosition,
+			[MessageLeave] = handleLeave, [MessageDrop] = handleDrop },
+		[PhaseDropping] = { ALWAYS_HANDLED, [MessageLeave] = handleLeave }
+	}
+};
+
+// The role we have in an exchange, for each message a peer can send us in one
+static const XdndRole messageRoles[NumberOfMessages] = {
+	[MessageEnter] = RoleTarget,
+	[MessagePosition] = RoleTarget,
+	[MessageLeave] = RoleTarget,
+	[MessageDrop] = RoleTarget,
+	[MessageStatus] = RoleSource,
+	[MessageFinished] = RoleSource
+};
+
+// This maps a client message type onto its dense message ID
+XdndMessage getXdndMessage(Atom messageType)
+{
+	unsigned int slot = (uint32_t)(messageType * 2654435761u) % MESSAGE_LOOKUP_SIZE;
+	while (messageLookupKeys[slot] != None) {
+		if (messageLookupKeys[slot] == messageType)
+			return messageLookupIds[slot];
+		slot = (slot + 1) % MESSAGE_LOOKUP_SIZE;
+	}
+
+	return MessageOther;
+}
+
+// This returns the transition to take for a client message, or NULL if it should be
+// ignored. XDND messages all carry the peer window first, which with the role the message
+// is sent to us in finds the session whose phase picks the transition - with no session,
+// only XdndEnter is taken
+XdndTransition lookupXdndTransition(XClientMessageEvent *message, XdndSession **sessionReturn)
+{
+	XdndMessage id = getXdndMessage(message->message_type);
+	XdndSession *session = NULL;
+
+	if (messageRoles[id] != RoleNone)
+		session = findXdndSession(&xdndSessions, message->data.l[0], messageRoles[id]);
+	*sessionReturn = session;
+
+	if (!session)
+		return transitionTable[RoleNone][PhaseIdle][id];
+	return transitionTable[session->role][session->phase][id];
+}
+
+// This defines all of our atoms with a single round trip, then builds the message lookup
+void initXdndAtoms(Display *disp)
+{
+	char *names[NUMBER_OF_ATOMS];
+	Atom atoms[NUMBER_OF_ATOMS];
+
+	for (int i = 0; i < NUMBER_OF_ATOMS; ++i)
+		names[i] = (char *)atomTable[i].name;
+	if (XInternAtoms(disp, names, NUMBER_OF_ATOMS, False, atoms) == 0)
+		philError("XInternAtoms");
+	for (int i = 0; i < NUMBER_OF_ATOMS; ++i)
+		*atomTable[i].atom = atoms[i];
+
+	memset(messageLookupKeys, 0, sizeof(messageLookupKeys));
+	for (int i = 0; i < sizeof(messageAtoms) / sizeof(messageAtoms[0]); ++i) {
+		Atom key = *messageAtoms[i].atom;
+		unsigned int slot = (uint32_t)(key * 2654435761u) % MESSAGE_LOOKUP_SIZE;
+		while (messageLookupKeys[slot] != None && messageLookupKeys[slot] != key)
+			slot = (slot + 1) % MESSAGE_LOOKUP_SIZE;
+		messageLookupKeys[slot] = key;
+		messageLookupIds[slot] = messageAtoms[i].message;
+	}
+}
+
+// These expose the atom table, so traces can record the values we were given
+int getXdndAtomCount(void)
+{
+	return NUMBER_OF_ATOMS;
+}
+
+const char *getXdndAtomName(int index)
+{
+	return atomTable[index].name;
+}
+
+Atom getXdndAtom(int index)
+{
+	return *atomTable[index].atom;
+}
+
+// This advertises XDND support on the window, and asks for WM_DELETE_WINDOW
+void setXdndWindowProperties(Display *disp, Window wind)
+{
+	unsigned int xdndVersion = XDND_PROTOCOL_VERSION;
+
+	// Add XdndAware property
+	XChangeProperty(disp, wind, XdndAware,
+			XA_ATOM, 32, PropModeReplace,
+			(void *)&xdndVersion, 1);
+
+	// List the actions a target can pick from when we ask it to - these never change, so
+	// are set once here rather than for every drag
+	Atom actionList[NUMBER_OF_OFFERED_ACTIONS];
+	for (int i = 0; i < NUMBER_OF_OFFERED_ACTIONS; ++i)
+		actionList[i] = *dragActionAtoms[offeredActions[i]];
+	XChangeProperty(disp, wind, XdndActionList, XA_ATOM, 32, PropModeReplace,
+			(void *)actionList, NUMBER_OF_OFFERED_ACTIONS);
+	XChangeProperty(disp, wind, XdndActionDescription, typesWeAccept[3], 8, PropModeReplace,
+			(const unsigned char *)offeredActionDescriptions, sizeof(offeredActionDescriptions));
+
+	// Set WM_PROTOCOLS to add WM_DELETE_WINDOW atom so we can end app gracefully
+	XSetWMProtocols(disp, wind, &WM_DELETE_WINDOW, 1);
+}
+
+// This sets up the per-window state, including the background loader used for dropped
+// state and the protocol timeout timer
+void initWindowContext(WindowContext *ctx, Display *disp, Window wind, GC gContext,
+	Renderer *renderer, RenderThread *renderThread, pid_t procId, const SpawnOptions *options)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->disp = disp;
+	ctx->wind = wind;
+	ctx->gContext = gContext;
+	ctx->renderer = renderer;
+	ctx->renderThread = renderThread;
+	ctx->procStr = procId == 0 ? "Phil" : "Stuart";
+	ctx->options = options;
+
+	// Define colours
+	ctx->red = 0xFF << 16;
+	ctx->blue = 0xFF;
+	ctx->green = 0xFF << 8; // Just green component
+	ctx->white = 0xFFFFFF;
+	ctx->foreground = ctx->red;
+
+	// Set square to visible if we are Phil
+	ctx->square.size = 50;
+	ctx->square.colour = RedSquare;
+	ctx->square.visible = procId == 0;
+
+	ctx->continueEventLoop = true;
+	initDropLoader(&ctx->loader);
+	initPayloadWriter(&ctx->payload, (size_t)options->previewMegabytes * 1024 * 1024);
+	initXdndTimer(&ctx->timer);
+	initDragIcon(&ctx->icon, disp, ctx->square.size);
+	initKeyBindings(&ctx->bindings, disp);
+	initContentCache(&ctx->cache, (size_t)options->cacheMegabytes * 1024 * 1024);
+
+	// MIDI chunks have to fit in a single ChangeProperty request
+	ctx->midiSender.chunkBytes = MIDI_CHUNK_BYTES;
+	if (ctx->midiSender.chunkBytes > XMaxRequestSize(disp) * 4 - 64)
+		ctx->midiSender.chunkBytes = XMaxRequestSize(disp) * 4 - 64;
+	if (options->midiMegabytes > 0) {
+		ctx->midiSender.chunk = malloc(ctx->midiSender.chunkBytes);
+		ctx->midiSender.encoded = malloc(ctx->midiSender.chunkBytes);
+		if (!ctx->midiSender.chunk || !ctx->midiSender.encoded)
+			philError("malloc");
+	}
+	initChunkCodec(&ctx->midiSender.codec);
+	initChunkCodec(&ctx->midiReceiver.codec);
+}
+
+// This starts an exchange with a target as the source of a pointer's drag. A target we are
+// still dropping on from another pointer has to finish with that drop first
+static XdndSession *enterTarget(WindowContext *ctx, PointerDrag *drag, Window targetWindow,
+	int version, Time time)
+{
+	// Start a session for the target
+	if (findXdndSession(&xdndSessions, targetWindow, RoleSource))
+		return NULL;
+	XdndSession *session = createXdndSession(&xdndSessions, targetWindow, ctx->wind, RoleSource);
+	if (!session)
+		return NULL;
+
+	// Claim ownership of Xdnd selection
+	XSetSelectionOwner(ctx->disp, XdndSelection, ctx->wind, time);
+	ctx->ownsXdndSelection = true;
+
+	// Send XdndEnter message, offering MIDI first if asked to - compressed before plain
+	// where we can - and always naming the content with its hash
+	Atom types[4];
+	int numberOfTypes = 0;
+	if (ctx->options->midiMegabytes > 0) {
+		if (isChunkCompressionAvailable())
+			types[numberOfTypes++] = typesWeAccept[MIDI_ZSTD_TYPE];
+		types[numberOfTypes++] = typesWeAccept[MIDI_TYPE];
+	}
+	types[numberOfTypes++] = typesWeAccept[0];
+	types[numberOfTypes++] = getContentType(ctx);
+	printf("%s: sending XdndEnter to target window 0x%lx\n", ctx->procStr, targetWindow);
+	sendXdndEnter(ctx->disp, version, ctx->wind, session, types, numberOfTypes);
+
+	// Write out what we would drop now, so it is ready when asked for
+	if (!ctx->options->lazyPayload)
+		startPayloadWrite(&ctx->payload, &ctx->square);
+	session->phase = PhaseNegotiating;
+	session->version = version;
+	drag->session = session;
+	armSessionTimer(ctx, session, StatusTimeout);
+	return session;
+}
+
+// This picks up a modifier going down or up mid-drag, and lets the target know straight
+// away if that changes the action. The keyboard acts on whichever pointer holds the square
+static void updateDragModifiers(WindowContext *ctx, XKeyEvent *event)
+{
+	unsigned int modifierState = applyModifierKey(&ctx->bindings, event);
+	PointerDrag *drag = ctx->holder;
+	if (!drag)
+		return;
+	DragAction oldAction = getDragAction(drag->modifierState);
+
+	drag->modifierState = modifierState;
+	XdndSession *session = drag->session;
+	if (session && (session->phase == PhaseNegotiating || session->phase == PhaseAccepted) &&
+		getDragAction(modifierState) != oldAction) {
+		drag->time = event->time;
+		sendDragPosition(ctx, drag);
+	}
+}
+
+// This handles a single event from the X server
+void handleEvent(WindowContext *ctx, XEvent *event)
+{
+	switch (event->type) {
+	// We are being asked for X selection data by the target
+	case SelectionRequest: {
+		XdndSession *session = findXdndSession(&xdndSessions, event->xselectionrequest.requestor,
+			RoleSource);
+		Atom requested = event->xselectionrequest.target;
+		if (session && session->role == RoleSource && ctx->options->midiMegabytes > 0 &&
+			(requested == typesWeAccept[MIDI_TYPE] || (requested == typesWeAccept[MIDI_ZSTD_TYPE] &&
+			isChunkCompressionAvailable()))) {
+			// Stream the square out as MIDI, a chunk at a time
+			startMidiSend(ctx, &event->xselectionrequest);
+		} else if (session && session->role == RoleSource) {
+			// Add data to the target window - normally written while we were dragging
+			ctx->payloadTakenBy = session->peer;
+			sendSelectionNotify(ctx->disp, session, &event->xselectionrequest,
+				getPayload(&ctx->payload, &ctx->square));
+		} else {
+			// Not a window we are dragging onto - say so, rather than leave it waiting
+			refuseSelectionRequest(ctx->disp, &event->xselectionrequest);
+		}
+		break;
+	}
+	// Another drag has taken XdndSelection from us, so a drop of ours has to take it back
+	case SelectionClear:
+		if (event->xselectionclear.selection == XdndSelection)
+			ctx->ownsXdndSelection = false;
+		break;
+	// We have received a selection notification
+	case SelectionNotify:
+		// The answer to a conversion made ahead of a drop - a refusal names no property, so
+		// one is only taken as ours while no drop is being converted
+		if (event->xselection.property == XDND_PREFETCH || (event->xselection.property == None &&
+			ctx->prefetch.converting && ctx->droppingPeer == None)) {
+			handlePrefetchNotify(ctx, &event->xselection);
+			break;
+		}
+
+		// The source has refused our drop - most likely another drag took XdndSelection
+		// before we asked for it - so give up on it now rather than wait for the timeout
+		if (event->xselection.property == None && ctx->droppingPeer != None) {
+			XdndSession *refused = findXdndSession(&xdndSessions, ctx->droppingPeer, RoleTarget);
+			if (refused && (uint32_t)event->xselection.time == refused->dropTimestamp) {
+				printf("%s: window 0x%lx refused to convert the drop, sending XdndFinished\n",
+					ctx->procStr, refused->peer);
+				sendXdndFinished(ctx->disp, ctx->wind, refused, false);
+				endXdndSession(ctx, refused);
+			}
+			break;
+		}
+
+		// Ignore if not XDND related
+		if (event->xselection.property != XDND_DATA)
+			break;
+
+		// The source answers in order, so anything it was asked ahead of the drop has been
+		// answered by now
+		ctx->prefetch.converting = false;
+
+		// An answer that comes once the drop has been given up on - the source was already
+		// told it failed - must not land the square after all
+		XdndSession *dropSession = findXdndSession(&xdndSessions, ctx->droppingPeer, RoleTarget);
+		if (!dropSession) {
+			printf("%s: no drop waiting on this selection, ignoring it\n", ctx->procStr);
+			XDeleteProperty(ctx->disp, ctx->wind, XDND_DATA);
+			break;
+		}
+
+		// The source has answered, so stop waiting on it
+		disarmSessionTimer(ctx, dropSession);
+
+		// MIDI is parsed as it streams in, and the exchange finishes once it has all come
+		if (dropSession->proposedType == typesWeAccept[MIDI_TYPE] ||
+			dropSession->proposedType == typesWeAccept[MIDI_ZSTD_TYPE]) {
+			landDroppedSquare(ctx, dropSession);
+			ctx->square.pending = true;
+			startMidiReceive(ctx, dropSession);
+			drawSquare(ctx);
+			break;
+		}
+
+		// Read data out into path string
+		char *pathStr = getCopiedData(ctx->disp, ctx->wind, XDND_DATA);
+
+		// Delete property on window
+		XDeleteProperty(ctx->disp, ctx->wind, XDND_DATA);
+
+		// No path means nothing to land, so the drop fails
+		if (!pathStr) {
+			printf("%s: no path in the dropped data, sending XdndFinished\n", ctx->procStr);
+			sendXdndFinished(ctx->disp, ctx->wind, dropSession, false);
+			endXdndSession(ctx, dropSession);
+			break;
+		}
+		landDroppedSquare(ctx, dropSession);
+
+		// Load this state in the background while the square shows as pending, reading
+		// all of it if it came with a content type, so it can be kept
+		ctx->loadingContentType = dropSession->contentType;
+		startDropLoad(&ctx->loader, pathStr, getDragActionForAtom(dropSession->acceptedAction),
+			ctx->loadingContentType != None ? ctx->cache.budgetBytes : 0);
+		ctx->square.pending = true;
+
+		// Send XdndFinished message straight away unless we are holding it back until
+		// the load completes
+		if (!ctx->options->finishAfterLoad) {
+			printf("%s: sending XdndFinished\n", ctx->procStr);
+			sendXdndFinished(ctx->disp, ctx->wind, dropSession, true);
+			endXdndSession(ctx, dropSession);
+		}
+		drawSquare(ctx);
+		break;
+	// A property has changed - the target taking a chunk of MIDI from its window, or the
+	// source putting the next one on ours
+	case PropertyNotify:
+		if (ctx->midiSender.active && event->xproperty.window == ctx->midiSender.requestor &&
+			event->xproperty.atom == ctx->midiSender.property &&
+			event->xproperty.state == PropertyDelete)
+			sendMidiChunk(ctx);
+		else if (ctx->midiReceiver.active && event->xproperty.window == ctx->wind &&
+			event->xproperty.atom == XDND_DATA && event->xproperty.state == PropertyNewValue)
+			handleMidiChunk(ctx);
+		break;
+	// Motion has been detected over this window from the mouse pointer
+	case MotionNotify: {
+		// Only the pointer holding the square moves it
+		PointerDrag *drag = getPointerDrag(ctx, ctx->pointerDevice);
+		if (drag && drag == ctx->holder) {
+			ctx->square.x += event->xmotion.x - drag->mouseX;
+			ctx->square.y += event->xmotion.y - drag->mouseY;
+			clampSquare(ctx);
+			drag->mouseX = event->xmotion.x;
+			drag->mouseY = event->xmotion.y;
+
+			if (!drag->stillInWindow) {
+				// Have the icon follow the pointer - it is moved once the queue is empty
+				showDragIcon(&ctx->icon, event->xmotion.x_root, event->xmotion.y_root,
+					ctx->square.colour == RedSquare ? ctx->red : ctx->blue);
+
+				// Find window cursor is over
+				Window targetWindow = getWindowPointerIsOver(ctx->disp, DefaultRootWindow(ctx->disp),
+					ctx->icon.wind, event->xmotion.x_root, event->xmotion.y_root, 0, 0);
+				if (targetWindow == None)
+					break;
+
+				// If cursor has moved out of previous window and cursor XDND
+				// exchange is ongoing, cancel it and reset state
+				XdndSession *session = drag->session;
+				if (session && targetWindow != session->peer) {
+					// Send XdndLeave message
+					printf("%s: sending XdndLeave message to target window 0x%lx\n",
+						ctx->procStr, session->peer);
+					sendXdndLeave(ctx->disp, ctx->wind, session);
+
+					// Wipe state back to default
+					endXdndSession(ctx, session);
+					session = NULL;
+				}
+
+				// Check state of window and engage XDND protocol exchange if needed
+				if (!session) {
+					// Check it supports XDND
+					int supportsXdnd = hasCorrectXdndAwareProperty(ctx->disp, targetWindow);
+					if (supportsXdnd == 0)
+						break;
+
+					session = enterTarget(ctx, drag, targetWindow, supportsXdnd,
+						event->xmotion.time);
+					if (!session)
+						break;
+				}
+
+				// Send XdndPosition message - once the target has accepted, only when it
+				// has answered the last one, so motion is coalesced while it is busy
+				drag->modifierState = event->xmotion.state;
+				drag->rootX = event->xmotion.x_root;
+				drag->rootY = event->xmotion.y_root;
+				drag->time = event->xmotion.time;
+				if (session->phase == PhaseNegotiating || drag->positionsAwaiting == 0)
+					sendDragPosition(ctx, drag);
+				else
+					drag->positionMoved = true;
+			}
+		}
+		drawSquare(ctx);
+		break;
+	}
+	// Key pressed - cancelling and modifiers act straight away
+	case KeyPress:
+		switch (lookupKeyAction(&ctx->bindings, event->xkey.keycode)) {
+		case ActionCancelDrag:
+			if (ctx->holder)
+				cancelDrag(ctx, ctx->holder);
+			break;
+		case ActionModifier:
+			updateDragModifiers(ctx, &event->xkey);
+			break;
+		default:
+			break;
+		}
+		break;
+	// Key released
+	case KeyRelease:
+		switch (lookupKeyAction(&ctx->bindings, event->xkey.keycode)) {
+		case ActionModifier:
+			updateDragModifiers(ctx, &event->xkey);
+			break;
+		case ActionToggleColour:
+			// Alternate colour
+			if (ctx->square.visible) {
+				ctx->square.colour = ctx->square.colour == RedSquare ? BlueSquare : RedSquare;
+				setForeground(ctx, ctx->square.colour == RedSquare ? ctx->red : ctx->blue);
+
+				// What we wrote out for the drag is stale now, and so is the content type
+				// we offered with it, so enter the target again with the new one - which
+				// also writes the payload again
+				invalidatePayload(&ctx->payload);
+				PointerDrag *drag = ctx->holder;
+				XdndSession *session = drag ? drag->session : NULL;
+				if (session && session->phase != PhaseDropping) {
+					Window target = session->peer;
+					int version = session->version;
+					printf("%s: sending XdndLeave message to target window 0x%lx as the square changed\n",
+						ctx->procStr, target);
+					sendXdndLeave(ctx->disp, ctx->wind, session);
+					endXdndSession(ctx, session);
+					drag->time = event->xkey.time;
+					session = enterTarget(ctx, drag, target, version, drag->time);
+					if (session)
+						sendDragPosition(ctx, drag);
+				}
+				drawSquare(ctx);
+			}
+			break;
+		default:
+			break;
+		}
+		break;
+	// The keyboard mapping has changed, so bindings need resolving again
+	case MappingNotify:
+		refreshKeyBindings(&ctx->bindings, ctx->disp, &event->xmapping);
+		break;
+	// Mouse button pressed
+	case ButtonPress: {
+		// The square goes to the first pointer to press on it - one whose drop is still
+		// finishing has to wait for it
+		PointerDrag *drag = getPointerDrag(ctx, ctx->pointerDevice);
+		if (drag && !ctx->holder && !drag->session &&
+			isPointerInsideSquare(event->xbutton.x, event->xbutton.y, &ctx->square)) {
+			// Set square properties
+			ctx->holder = drag;
+			drag->mouseX = event->xbutton.x;
+			drag->mouseY = event->xbutton.y;
+			drag->stillInWindow = true;
+			setForeground(ctx, ctx->green);
+			drawSquare(ctx);
+		}
+		break;
+	}
+	// Mouse button released
+	case ButtonRelease: {
+		PointerDrag *drag = getPointerDrag(ctx, ctx->pointerDevice);
+		if (!drag || drag != ctx->holder)
+			break;
+		XdndSession *session = drag->session;
+		if (session && session->phase == PhaseAccepted) {
+			// Another drag may have taken XdndSelection since this one started, and the
+			// target will ask whoever holds it for the data
+			if (!ctx->ownsXdndSelection) {
+				XSetSelectionOwner(ctx->disp, XdndSelection, ctx->wind, event->xbutton.time);
+				ctx->ownsXdndSelection = true;
+			}
+
+			// The target places the drop where the last XdndPosition said, so make sure
+			// that is where the button came up
+			if (drag->positionMoved || drag->rootX != event->xbutton.x_root ||
+				drag->rootY != event->xbutton.y_root) {
+				drag->rootX = event->xbutton.x_root;
+				drag->rootY = event->xbutton.y_root;
+				drag->time = event->xbutton.time;
+				sendDragPosition(ctx, drag);
+			}
+
+			// Send XdndDrop message
+			printf("%s: sending XdndDrop to target window\n", ctx->procStr);
+			sendXdndDrop(ctx->disp, ctx->wind, session);
+			clock_gettime(CLOCK_MONOTONIC, &drag->dropSentAt);
+			session->phase = PhaseDropping;
+			armSessionTimer(ctx, session, FinishedTimeout);
+		} else if (session && session->phase == PhaseNegotiating) {
+			// Released before the target answered, so there is nothing to drop on
+			printf("%s: sending XdndLeave message to target window 0x%lx "
+				"as button released before XdndStatus\n", ctx->procStr, session->peer);
+			sendXdndLeave(ctx->disp, ctx->wind, session);
+			endXdndSession(ctx, session);
+		}
+		hideDragIcon(&ctx->icon);
+
+		// Set square properties
+		ctx->holder = NULL;
+		setForeground(ctx, ctx->square.colour == RedSquare ? ctx->red : ctx->blue);
+		drawSquare(ctx);
+		break;
+	}
+	// Our window has moved or changed size - only the WM's synthetic events, or real ones
+	// while we are still a child of the root, are in root coordinates
+	case ConfigureNotify:
+		if (event->xconfigure.send_event || !ctx->reparented) {
+			ctx->originX = event->xconfigure.x + event->xconfigure.border_width;
+			ctx->originY = event->xconfigure.y + event->xconfigure.border_width;
+			ctx->originKnown = true;
+		} else {
+			ctx->originKnown = false;
+		}
+		break;
+	// A window manager has put a frame around us, so where we are is no longer known
+	case ReparentNotify:
+		ctx->reparented = event->xreparent.parent != DefaultRootWindow(ctx->disp);
+		ctx->originKnown = false;
+		break;
+	// Redraw the window if it was covered
+	case Expose:
+		drawSquare(ctx);
+		break;
+	// The pointer has entered our window
+	case EnterNotify:
+		if (ctx->holder && ctx->holder == getPointerDrag(ctx, ctx->pointerDevice)) {
+			ctx->holder->stillInWindow = true;
+			hideDragIcon(&ctx->icon);
+		}
+		break;
+	// The pointer has left our window
+	case LeaveNotify:
+		if (ctx->holder && ctx->holder == getPointerDrag(ctx, ctx->pointerDevice)) {
+			ctx->holder->stillInWindow = false;
+		}
+		break;
+	// This is where we receive messages from the other window
+	case ClientMessage: {
+		// Look up the transition for the sender's session and this message, then take it
+		XdndSession *session;
+		XdndTransition transition = lookupXdndTransition(&event->xclient, &session);
+		if (transition)
+			transition(ctx, session, &event->xclient);
+		break;
+	}
+	}
+}
+
+// This picks up dropped state once the loader has it
+void handleDropLoaded(WindowContext *ctx)
+{
+	// A drop landed from data fetched ahead has had the source's file taken over
+	if (ctx->loader.transferOnly) {
+		collectPrefetchMove(ctx);
+		return;
+	}
+
+	// Data fetched ahead lands the drop if it has come already, and waits for it if not
+	if (ctx->prefetch.loading) {
+		collectPrefetchLoad(ctx);
+		XdndSession *dropSession = findXdndSession(&xdndSessions, ctx->droppingPeer, RoleTarget);
+		if (dropSession && ctx->prefetch.phase == PrefetchReady &&
+			ctx->prefetch.peer == dropSession->peer)
+			commitPrefetch(ctx, dropSession);
+		return;
+	}
+
+	// A payload that couldn't be taken leaves no square to show
+	bool loaded = collectDropLoad(ctx);
+	ctx->square.pending = false;
+	if (loaded) {
+		printf("%s: %s %zu bytes of dropped state in %.3f ms\n", ctx->procStr,
+			getDragActionName(ctx->loader.action), ctx->loader.transferBytes,
+			ctx->loader.transferNs / 1e6);
+		noteDropLanded(ctx, "");
+	} else {
+		ctx->square.visible = false;
+	}
+
+	// Send XdndFinished message now, if we were holding it back until the load - only
+	// this drop's exchange is failed if the load was
+	XdndSession *dropSession = findXdndSession(&xdndSessions, ctx->droppingPeer, RoleTarget);
+	if (dropSession && ctx->options->finishAfterLoad) {
+		printf("%s: sending XdndFinished\n", ctx->procStr);
+		sendXdndFinished(ctx->disp, ctx->wind, dropSession, loaded);
+		endXdndSession(ctx, dropSession);
+	}
+	drawSquare(ctx);
+}
+
+// This abandons every exchange whose peer has stopped answering by its deadline
+void handleXdndTimeout(WindowContext *ctx)
+{
+	void *exchange;
+	XdndTimeoutKind kind;
+
+	while (expireXdndTimer(&ctx->timer, &exchange, &kind)) {
+		XdndSession *session = exchange;
+		printf("%s: timed out waiting for %s from window 0x%lx, resetting state "
+			"(timeouts so far - status: %lu, selection: %lu, finished: %lu)\n",
+			ctx->procStr, getXdndTimeoutName(kind), session->peer,
+			ctx->timer.timedOut[StatusTimeout], ctx->timer.timedOut[SelectionNotifyTimeout],
+			ctx->timer.timedOut[FinishedTimeout]);
+
+		// Tell the other side we are giving up on it
+		if (session->role == RoleSource)
+			sendXdndLeave(ctx->disp, ctx->wind, session);
+		else
+			sendXdndFinished(ctx->disp, ctx->wind, session, false);
+		endXdndSession(ctx, session);
+	}
+}
+
+// This abandons the exchanges with peers that failed a request we made for them - almost
+// always because their window has been destroyed. Nothing is sent to the peer, as that
+// would only fail the same way, and exchanges with every other window carry on
+void handleXErrors(WindowContext *ctx)
+{
+	XPeerError error;
+
+	while (takeXPeerError(&error)) {
+		for (XdndRole role = RoleSource; role <= RoleTarget; ++role) {
+			XdndSession *session = findXdndSession(&xdndSessions, error.peer, role);
+			if (!session)
+				continue;
+
+			printf("%s: X error %d from request %d to window 0x%lx, abandoning the exchange\n",
+				ctx->procStr, error.errorCode, error.requestCode, error.peer);
+			ctx->abandonedAfterErrors++;
+			endXdndSession(ctx, session);
+		}
+	}
+}
+
+// This reports how many exchanges had to be abandoned, then tears down the per-window state
+void destroyWindowContext(WindowContext *ctx)
+{
+	const XErrorCounts *errorCounts = getXErrorCounts();
+
+	printf("%s: timed out exchanges - status: %lu, selection: %lu, finished: %lu\n", ctx->procStr,
+		ctx->timer.timedOut[StatusTimeout], ctx->timer.timedOut[SelectionNotifyTimeout],
+		ctx->timer.timedOut[FinishedTimeout]);
+	printf("%s: exchanges abandoned after X errors: %lu (errors from exchanges: %lu, "
+		"from elsewhere: %lu)\n", ctx->procStr, ctx->abandonedAfterErrors,
+		errorCounts->attributed + errorCounts->dropped, errorCounts->unattributed);
+	printf("%s: drag icon moves: %lu\n", ctx->procStr, ctx->icon.moves);
+	if (ctx->statusReplies > 0)
+		printf("%s: XdndPosition to XdndStatus - mean %.3f ms, worst %.3f ms over %lu replies\n",
+			ctx->procStr, ctx->statusLatencyTotalMs / ctx->statusReplies,
+			ctx->statusLatencyMaxMs, ctx->statusReplies);
+	printf("%s: dropped data ready when asked for: %lu, written on demand: %lu\n",
+		ctx->procStr, ctx->payload.hits, ctx->payload.misses);
+	if (ctx->dropsLanded > 0)
+		printf("%s: XdndDrop to square shown - mean %.3f ms, worst %.3f ms over %lu drops\n",
+			ctx->procStr, ctx->landLatencyTotalMs / ctx->dropsLanded, ctx->landLatencyMaxMs,
+			ctx->dropsLanded);
+	if (ctx->options->prefetchDrops)
+		printf("%s: data fetched ahead of the drop - used: %lu, thrown away: %lu\n",
+			ctx->procStr, ctx->prefetch.committed, ctx->prefetch.discarded);
+	if (ctx->cache.hits + ctx->cache.misses > 0)
+		printf("%s: dropped content already held: %lu of %lu drops (%.1f%%), %zu bytes not sent\n",
+			ctx->procStr, ctx->cache.hits, ctx->cache.hits + ctx->cache.misses,
+			100.0 * ctx->cache.hits / (ctx->cache.hits + ctx->cache.misses),
+			ctx->cache.bytesSaved);
+
+	releaseXdndSessionsOwnedBy(&xdndSessions, ctx->wind);
+	destroyDragIcon(&ctx->icon);
+	destroyXdndTimer(&ctx->timer);
+	destroyDropLoader(&ctx->loader);
+	clearPrefetch(&ctx->prefetch);
+	destroyPayloadWriter(&ctx->payload);
+	destroyContentCache(&ctx->cache);
+	if (ctx->midiSender.codec.rawBytes > 0 || ctx->midiReceiver.codec.rawBytes > 0)
+		printf("%s: compressed MIDI chunks - sent %lu compressed and %lu stored, %zu bytes as %zu; "
+			"received %lu compressed and %lu stored, %zu bytes as %zu\n", ctx->procStr,
+			ctx->midiSender.codec.compressedChunks, ctx->midiSender.codec.storedChunks,
+			ctx->midiSender.codec.rawBytes, ctx->midiSender.codec.wireBytes,
+			ctx->midiReceiver.codec.compressedChunks, ctx->midiReceiver.codec.storedChunks,
+			ctx->midiReceiver.codec.rawBytes, ctx->midiReceiver.codec.wireBytes);
+	destroyChunkCodec(&ctx->midiSender.codec);
+	destroyChunkCodec(&ctx->midiReceiver.codec);
+	free(ctx->midiSender.chunk);
+	free(ctx->midiSender.encoded);
+	free(ctx->midiReceiver.decoded);
+}
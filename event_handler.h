@@ -0,0 +1,203 @@
+/* Copyright Phillip Potter, 2020 - MIT License
+ * Copyright xlib_xdnd contributors, 2026
+ * Header file for event_handler.c */
+#ifndef EVENT_HANDLER
+#define EVENT_HANDLER
+
+#include <sys/types.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <X11/Xlib.h>
+#include "spawn_window.h"
+#include "square_state.h"
+#include "drop_loader.h"
+#include "payload_writer.h"
+#include "xdnd_timer.h"
+#include "xdnd_session.h"
+#include "renderer.h"
+#include "render_thread.h"
+#include "drag_icon.h"
+#include "key_bindings.h"
+#include "midi_stream.h"
+#include "content_cache.h"
+#include "chunk_codec.h"
+
+// Client messages we dispatch on, as dense IDs
+typedef enum {
+	MessageOther = 0,
+	MessageEnter,
+	MessagePosition,
+	MessageLeave,
+	MessageStatus,
+	MessageDrop,
+	MessageFinished,
+	MessageWmProtocols,
+	NumberOfMessages
+} XdndMessage;
+
+// A MIDI file going out to a target, one INCR chunk each time it deletes the last
+typedef struct {
+	bool active;
+	Window requestor;
+	Atom property;
+	Atom type;
+	bool compressed;
+	MidiProducer producer;
+	unsigned char *chunk;
+	unsigned char *encoded;
+	size_t chunkBytes;
+	unsigned long chunks;
+	size_t wireBytes;
+	ChunkCodec codec;
+} MidiSender;
+
+// A MIDI file coming in from a source, parsed as each chunk arrives
+typedef struct {
+	bool active;
+	MidiParser parser;
+	struct timespec dropReceivedAt;
+	double firstEventMs;
+	unsigned long chunks;
+	size_t wireBytes;
+	unsigned char *decoded;
+	size_t decodedCapacity;
+	ChunkCodec codec;
+} MidiReceiver;
+
+// The most pointers that can have drags of their own at once
+#define MAX_POINTER_DRAGS 8
+
+// The most unanswered XdndPosition messages a drag keeps send times for
+#define MAX_TIMED_POSITIONS 16
+
+// One pointer's drag. Under XInput2 every master pointer presses, moves and releases on its
+// own, so each keeps its own drag and its own exchange with the window it is over - the
+// core pointer is device 0. Only one pointer holds the square at a time, but one pointer's
+// drop can still be finishing while another picks the square up again. The target answers
+// every XdndPosition in order, so each XdndStatus is timed against the oldest one sent -
+// send times are kept for the oldest few still waiting. Once the target has accepted, motion
+// while an XdndPosition is unanswered is held back, with positionMoved saying the next
+// XdndStatus should be followed by one from wherever the pointer has got to
+typedef struct {
+	int device;
+	bool inUse;
+	int mouseX;
+	int mouseY;
+	bool stillInWindow;
+	XdndSession *session;
+	unsigned int modifierState;
+	int rootX;
+	int rootY;
+	Time time;
+	struct timespec positionsSentAt[MAX_TIMED_POSITIONS];
+	int oldestPosition;
+	int positionsTimed;
+	int positionsAwaiting;
+	bool positionMoved;
+	struct timespec dropSentAt;
+} PointerDrag;
+
+// How far fetching the data of a drag still hovering over us has got
+typedef enum {
+	PrefetchIdle = 0,
+	// XConvertSelection sent, waiting for SelectionNotify
+	PrefetchConverting,
+	// Path received, the loader is reading the state
+	PrefetchLoading,
+	// State read, waiting for XdndDrop
+	PrefetchReady
+} PrefetchPhase;
+
+// The data of a drag hovering over us, fetched before it is dropped so the drop can land
+// straight away. The source's file is only read - it is taken the way the drop says once
+// it comes, and a move that takes it over on the loader holds the drop's XdndFinished,
+// for movingPeer, until it is done
+typedef struct {
+	PrefetchPhase phase;
+	Window peer;
+	Window movingPeer;
+	bool converting;
+	bool loading;
+	char *pathStr;
+	Square square;
+	unsigned char *content;
+	size_t contentSize;
+	unsigned long committed;
+	unsigned long discarded;
+} DropPrefetch;
+
+// Everything the handlers need to know about one window
+typedef struct {
+	Display *disp;
+	Window wind;
+	GC gContext;
+	Renderer *renderer;
+	RenderThread *renderThread;
+	const char *procStr;
+	const SpawnOptions *options;
+	unsigned long red;
+	unsigned long blue;
+	unsigned long green;
+	unsigned long white;
+	unsigned long foreground;
+	Square square;
+	PointerDrag drags[MAX_POINTER_DRAGS];
+	PointerDrag *holder;
+	int pointerDevice;
+	bool continueEventLoop;
+	DropLoader loader;
+	PayloadWriter payload;
+	bool ownsXdndSelection;
+	unsigned long drops;
+	double dropLatencyTotalMs;
+	unsigned long statusReplies;
+	double statusLatencyTotalMs;
+	double statusLatencyMaxMs;
+	XdndTimer timer;
+	DragIcon icon;
+	KeyBindings bindings;
+	int originX;
+	int originY;
+	bool originKnown;
+	bool reparented;
+	Window droppingPeer;
+	MidiSender midiSender;
+	MidiReceiver midiReceiver;
+	Window payloadTakenBy;
+	Atom contentTypes[NumberOfSquareColours];
+	ContentCache cache;
+	Atom loadingContentType;
+	unsigned long abandonedAfterErrors;
+	DropPrefetch prefetch;
+	unsigned long dropsLanded;
+	double landLatencyTotalMs;
+	double landLatencyMaxMs;
+} WindowContext;
+
+typedef void (*XdndTransition)(WindowContext *ctx, XdndSession *session, XClientMessageEvent *message);
+
+void initXdndAtoms(Display *disp);
+XdndMessage getXdndMessage(Atom messageType);
+XdndTransition lookupXdndTransition(XClientMessageEvent *message, XdndSession **sessionReturn);
+int getXdndAtomCount(void);
+const char *getXdndAtomName(int index);
+Atom getXdndAtom(int index);
+void setXdndWindowProperties(Display *disp, Window wind);
+void sendXdndEnter(Display *disp, int xdndVersion, Window source, XdndSession *session,
+	const Atom *types, int numberOfTypes);
+void sendXdndPosition(Display *disp, Window source, XdndSession *session, int time, int p_rootX,
+	int p_rootY, Atom action);
+void sendXdndLeave(Display *disp, Window source, XdndSession *session);
+void sendXdndDrop(Display *disp, Window source, XdndSession *session);
+void sendSelectionNotify(Display *disp, XdndSession *session,
+	XSelectionRequestEvent *selectionRequest, const char *pathStr);
+void initWindowContext(WindowContext *ctx, Display *disp, Window wind, GC gContext,
+	Renderer *renderer, RenderThread *renderThread, pid_t procId, const SpawnOptions *options);
+void handleEvent(WindowContext *ctx, XEvent *event);
+void handleDropLoaded(WindowContext *ctx);
+void handleXdndTimeout(WindowContext *ctx);
+void handleXErrors(WindowContext *ctx);
+void destroyWindowContext(WindowContext *ctx);
+
+#endif
@@ -0,0 +1,236 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This records the events the loop handles to a compact binary trace, and reads them back
+ * for replay. Traces are written in host byte order, so only replay them on the same
+ * architecture they were recorded on.
+ *
+ * Layout: the magic and version, whether this was Phil's window, our window and root window
+ * IDs, then the atom table (value, name length, name) so replay can hand out the same atom
+ * values. After that each record is a timestamp in nanoseconds since the trace was opened,
+ * the event type, the payload size and the payload - just the part of XEvent that type uses,
+ * or an int32_t device ID for a change of master pointer */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <X11/Xlib.h>
+#include "event_trace.h"
+#include "event_handler.h"
+#include "phil_error.h"
+
+#define TRACE_MAGIC "XDNDTRC1"
+#define TRACE_VERSION 1
+
+// This says how much of XEvent a given event type actually uses
+static size_t getEventPayloadSize(int type)
+{
+	switch (type) {
+	case KeyPress:
+	case KeyRelease:
+		return sizeof(XKeyEvent);
+	case ButtonPress:
+	case ButtonRelease:
+		return sizeof(XButtonEvent);
+	case MotionNotify:
+		return sizeof(XMotionEvent);
+	case EnterNotify:
+	case LeaveNotify:
+		return sizeof(XCrossingEvent);
+	case Expose:
+		return sizeof(XExposeEvent);
+	case SelectionRequest:
+		return sizeof(XSelectionRequestEvent);
+	case SelectionNotify:
+		return sizeof(XSelectionEvent);
+	case PropertyNotify:
+		return sizeof(XPropertyEvent);
+	case ClientMessage:
+		return sizeof(XClientMessageEvent);
+	case TRACE_DROP_LOADED:
+		return 0;
+	case TRACE_POINTER_DEVICE:
+		return sizeof(int32_t);
+	default:
+		return sizeof(XEvent);
+	}
+}
+
+// These write and read fixed size fields, failing hard as a short trace is useless
+static void writeField(EventTrace *trace, const void *data, size_t size)
+{
+	if (size > 0 && fwrite(data, size, 1, trace->file) != 1)
+		philError("fwrite");
+}
+
+static bool readField(TraceReader *reader, void *data, size_t size)
+{
+	return size == 0 || fread(data, size, 1, reader->file) == 1;
+}
+
+// This writes a record header and payload, stamped with the time since the trace was opened
+static void writeRecord(EventTrace *trace, int type, const void *payload, size_t size)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	uint64_t timestampNs = (uint64_t)(now.tv_sec - trace->start.tv_sec) * 1000000000ULL +
+		now.tv_nsec - trace->start.tv_nsec;
+	uint16_t recordType = type;
+	uint16_t recordSize = size;
+
+	writeField(trace, &timestampNs, sizeof(timestampNs));
+	writeField(trace, &recordType, sizeof(recordType));
+	writeField(trace, &recordSize, sizeof(recordSize));
+	writeField(trace, payload, size);
+}
+
+// This creates the trace file and writes its header, including our atom values
+void openEventTrace(EventTrace *trace, const char *path, pid_t procId, Window wind, Window root)
+{
+	trace->file = fopen(path, "wb");
+	if (!trace->file)
+		philError("fopen");
+	clock_gettime(CLOCK_MONOTONIC, &trace->start);
+
+	uint32_t version = TRACE_VERSION;
+	uint8_t isPhil = procId == 0;
+	uint64_t windowId = wind, rootId = root;
+	uint32_t numberOfAtoms = getXdndAtomCount();
+
+	writeField(trace, TRACE_MAGIC, strlen(TRACE_MAGIC));
+	writeField(trace, &version, sizeof(version));
+	writeField(trace, &isPhil, sizeof(isPhil));
+	writeField(trace, &windowId, sizeof(windowId));
+	writeField(trace, &rootId, sizeof(rootId));
+	writeField(trace, &numberOfAtoms, sizeof(numberOfAtoms));
+	for (int i = 0; i < numberOfAtoms; ++i) {
+		uint64_t value = getXdndAtom(i);
+		uint16_t nameLength = strlen(getXdndAtomName(i));
+		writeField(trace, &value, sizeof(value));
+		writeField(trace, &nameLength, sizeof(nameLength));
+		writeField(trace, getXdndAtomName(i), nameLength);
+	}
+}
+
+// This records an event from the X server
+void recordEvent(EventTrace *trace, XEvent *event)
+{
+	// The display pointer means nothing outside this process, so don't store it
+	XEvent copy = *event;
+	copy.xany.display = NULL;
+	writeRecord(trace, copy.type, &copy, getEventPayloadSize(copy.type));
+}
+
+// This records the drop loader finishing
+void recordDropLoaded(EventTrace *trace)
+{
+	writeRecord(trace, TRACE_DROP_LOADED, NULL, 0);
+}
+
+// This records the master pointer that the pointer events after it come from
+void recordPointerDevice(EventTrace *trace, int device)
+{
+	int32_t deviceId = device;
+	writeRecord(trace, TRACE_POINTER_DEVICE, &deviceId, getEventPayloadSize(TRACE_POINTER_DEVICE));
+}
+
+// This flushes and closes the trace
+void closeEventTrace(EventTrace *trace)
+{
+	if (fclose(trace->file) != 0)
+		philError("fclose");
+}
+
+// This opens a trace and reads its header
+void openTraceReader(TraceReader *reader, const char *path)
+{
+	char magic[sizeof(TRACE_MAGIC)] = { 0 };
+	uint32_t version, numberOfAtoms;
+	uint8_t isPhil;
+	uint64_t windowId, rootId;
+
+	reader->file = fopen(path, "rb");
+	if (!reader->file)
+		philError("fopen");
+
+	if (!readField(reader, magic, strlen(TRACE_MAGIC)) || strcmp(magic, TRACE_MAGIC) != 0)
+		philError("%s: not an event trace", path);
+	if (!readField(reader, &version, sizeof(version)) || version != TRACE_VERSION)
+		philError("%s: unsupported trace version", path);
+	if (!readField(reader, &isPhil, sizeof(isPhil)) ||
+		!readField(reader, &windowId, sizeof(windowId)) ||
+		!readField(reader, &rootId, sizeof(rootId)) ||
+		!readField(reader, &numberOfAtoms, sizeof(numberOfAtoms)))
+		philError("%s: truncated trace header", path);
+	reader->isPhil = isPhil;
+	reader->wind = windowId;
+	reader->root = rootId;
+	reader->numberOfAtoms = numberOfAtoms;
+
+	// Read atom table
+	reader->atomNames = calloc(numberOfAtoms, sizeof(char *));
+	reader->atoms = calloc(numberOfAtoms, sizeof(Atom));
+	if (!reader->atomNames || !reader->atoms)
+		philError("calloc");
+	for (int i = 0; i < numberOfAtoms; ++i) {
+		uint64_t value;
+		uint16_t nameLength;
+		if (!readField(reader, &value, sizeof(value)) ||
+			!readField(reader, &nameLength, sizeof(nameLength)))
+			philError("%s: truncated atom table", path);
+		reader->atomNames[i] = malloc(nameLength + 1);
+		if (!reader->atomNames[i])
+			philError("malloc");
+		if (!readField(reader, reader->atomNames[i], nameLength))
+			philError("%s: truncated atom table", path);
+		reader->atomNames[i][nameLength] = '\0';
+		reader->atoms[i] = value;
+	}
+
+	reader->firstRecord = ftell(reader->file);
+}
+
+// This reads the next record, returning false at the end of the trace
+bool readTraceRecord(TraceReader *reader, TraceRecord *record)
+{
+	uint16_t recordType, recordSize;
+
+	if (!readField(reader, &record->timestampNs, sizeof(record->timestampNs)) ||
+		!readField(reader, &recordType, sizeof(recordType)) ||
+		!readField(reader, &recordSize, sizeof(recordSize)))
+		return false;
+	if (recordSize > sizeof(XEvent))
+		philError("corrupt trace record");
+
+	memset(&record->event, 0, sizeof(record->event));
+	if (!readField(reader, &record->event, recordSize))
+		return false;
+	record->type = recordType;
+
+	// A device change has no event, just the device ID
+	record->device = 0;
+	if (recordType == TRACE_POINTER_DEVICE) {
+		int32_t deviceId;
+		memcpy(&deviceId, &record->event, sizeof(deviceId));
+		record->device = deviceId;
+	}
+
+	return true;
+}
+
+// This goes back to the first record
+void rewindTraceReader(TraceReader *reader)
+{
+	if (fseek(reader->file, reader->firstRecord, SEEK_SET) != 0)
+		philError("fseek");
+}
+
+// This closes the trace and frees the atom table
+void closeTraceReader(TraceReader *reader)
+{
+	for (int i = 0; i < reader->numberOfAtoms; ++i)
+		free(reader->atomNames[i]);
+	free(reader->atomNames);
+	free(reader->atoms);
+	fclose(reader->file);
+}
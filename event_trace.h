@@ -0,0 +1,55 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for recording and reading back event traces */
+#ifndef EVENT_TRACE
+#define EVENT_TRACE
+
+#include <sys/types.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <X11/Xlib.h>
+
+// Pseudo event type recorded when the drop loader finished, as that drives the handlers too
+#define TRACE_DROP_LOADED (LASTEvent + 1)
+
+// Pseudo event type recorded when pointer events start coming from another master pointer
+#define TRACE_POINTER_DEVICE (LASTEvent + 2)
+
+// Trace writer structure
+typedef struct {
+	FILE *file;
+	struct timespec start;
+} EventTrace;
+
+// One record read back from a trace
+typedef struct {
+	uint64_t timestampNs;
+	int type;
+	XEvent event;
+	int device;
+} TraceRecord;
+
+// Trace reader structure - the header is read up front
+typedef struct {
+	FILE *file;
+	long firstRecord;
+	bool isPhil;
+	Window wind;
+	Window root;
+	int numberOfAtoms;
+	char **atomNames;
+	Atom *atoms;
+} TraceReader;
+
+void openEventTrace(EventTrace *trace, const char *path, pid_t procId, Window wind, Window root);
+void recordEvent(EventTrace *trace, XEvent *event);
+void recordDropLoaded(EventTrace *trace);
+void recordPointerDevice(EventTrace *trace, int device);
+void closeEventTrace(EventTrace *trace);
+void openTraceReader(TraceReader *reader, const char *path);
+bool readTraceRecord(TraceReader *reader, TraceRecord *record);
+void rewindTraceReader(TraceReader *reader);
+void closeTraceReader(TraceReader *reader);
+
+#endif
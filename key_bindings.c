@@ -0,0 +1,110 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This maps keys to what they do by keysym, so bindings follow the keyboard layout rather
+ * than assuming where a key sits. The keysyms are resolved into a table indexed by keycode
+ * once at startup, and again whenever the keyboard mapping changes, so handling a key
+ * is a single lookup - no XLookupString per event.
+ *
+ * Modifier keys are bound too, so a drag can update its action as soon as Shift or
+ * Control goes up or down, without waiting for the pointer to move */
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/keysym.h>
+#include "key_bindings.h"
+
+// Keysyms we bind, with what they do and any modifier they stand for
+static const struct {
+	KeySym keysym;
+	InputAction action;
+	unsigned int modifierMask;
+} bindingTable[] = {
+	{ XK_a, ActionToggleColour, 0 },
+	{ XK_Escape, ActionCancelDrag, 0 },
+	{ XK_Shift_L, ActionModifier, ShiftMask },
+	{ XK_Shift_R, ActionModifier, ShiftMask },
+	{ XK_Control_L, ActionModifier, ControlMask },
+	{ XK_Control_R, ActionModifier, ControlMask },
+	{ XK_Alt_L, ActionModifier, Mod1Mask },
+	{ XK_Alt_R, ActionModifier, Mod1Mask }
+};
+#define NUMBER_OF_BINDINGS (sizeof(bindingTable) / sizeof(bindingTable[0]))
+
+// Modifiers held during a drag, and the action they pick - as with other toolkits, Shift
+// moves (the default anyway, as the square goes where it is dropped), Control copies,
+// both together link, and Alt asks the target to choose
+static const struct {
+	unsigned int mask;
+	DragAction action;
+} dragActionTable[] = {
+	{ ShiftMask | ControlMask, DragLink },
+	{ ShiftMask, DragMove },
+	{ ControlMask, DragCopy },
+	{ Mod1Mask, DragAsk }
+};
+#define NUMBER_OF_DRAG_ACTIONS (sizeof(dragActionTable) / sizeof(dragActionTable[0]))
+
+// This resolves every binding against the current keyboard mapping
+void initKeyBindings(KeyBindings *bindings, Display *disp)
+{
+	int minKeycode, maxKeycode, keysymsPerKeycode;
+
+	memset(bindings, 0, sizeof(*bindings));
+	XDisplayKeycodes(disp, &minKeycode, &maxKeycode);
+	KeySym *keysyms = XGetKeyboardMapping(disp, minKeycode, maxKeycode - minKeycode + 1,
+		&keysymsPerKeycode);
+	if (!keysyms)
+		return;
+
+	// A keycode takes the first binding any of its keysyms has, so 'a' and 'A' both toggle
+	for (int keycode = minKeycode; keycode <= maxKeycode && keycode < KEYCODE_TABLE_SIZE; ++keycode) {
+		KeySym *keycodeSyms = keysyms + (keycode - minKeycode) * keysymsPerKeycode;
+		for (int i = 0; i < keysymsPerKeycode && !bindings->actions[keycode]; ++i) {
+			for (int j = 0; j < NUMBER_OF_BINDINGS; ++j) {
+				if (bindingTable[j].keysym == keycodeSyms[i]) {
+					bindings->actions[keycode] = bindingTable[j].action;
+					bindings->modifierMasks[keycode] = bindingTable[j].modifierMask;
+					break;
+				}
+			}
+		}
+	}
+
+	XFree(keysyms);
+}
+
+// This picks up a changed keyboard mapping
+void refreshKeyBindings(KeyBindings *bindings, Display *disp, XMappingEvent *event)
+{
+	XRefreshKeyboardMapping(event);
+	if (event->request == MappingKeyboard || event->request == MappingModifier)
+		initKeyBindings(bindings, disp);
+}
+
+// This says what a key does
+InputAction lookupKeyAction(KeyBindings *bindings, unsigned int keycode)
+{
+	if (keycode >= KEYCODE_TABLE_SIZE)
+		return ActionNone;
+	return bindings->actions[keycode];
+}
+
+// Key events carry the modifiers from just before the key, so this works out what they
+// are now that a modifier key has gone down or up
+unsigned int applyModifierKey(KeyBindings *bindings, XKeyEvent *event)
+{
+	unsigned int mask = event->keycode < KEYCODE_TABLE_SIZE ?
+		bindings->modifierMasks[event->keycode] : 0;
+
+	if (event->type == KeyPress)
+		return event->state | mask;
+	return event->state & ~mask;
+}
+
+// This picks the drag action for the modifiers held
+DragAction getDragAction(unsigned int modifierState)
+{
+	for (int i = 0; i < NUMBER_OF_DRAG_ACTIONS; ++i) {
+		if ((modifierState & dragActionTable[i].mask) == dragActionTable[i].mask)
+			return dragActionTable[i].action;
+	}
+	return DragMove;
+}
@@ -0,0 +1,31 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for keyboard bindings */
+#ifndef KEY_BINDINGS
+#define KEY_BINDINGS
+
+#include <X11/Xlib.h>
+#include "drag_action.h"
+
+// Things a key can be bound to
+typedef enum {
+	ActionNone = 0,
+	ActionToggleColour,
+	ActionCancelDrag,
+	ActionModifier,
+	NumberOfInputActions
+} InputAction;
+
+// Binding table - indexed directly by keycode, which X keeps within 8 to 255
+#define KEYCODE_TABLE_SIZE 256
+typedef struct {
+	unsigned char actions[KEYCODE_TABLE_SIZE];
+	unsigned char modifierMasks[KEYCODE_TABLE_SIZE];
+} KeyBindings;
+
+void initKeyBindings(KeyBindings *bindings, Display *disp);
+void refreshKeyBindings(KeyBindings *bindings, Display *disp, XMappingEvent *event);
+InputAction lookupKeyAction(KeyBindings *bindings, unsigned int keycode);
+unsigned int applyModifierKey(KeyBindings *bindings, XKeyEvent *event);
+DragAction getDragAction(unsigned int modifierState);
+
+#endif
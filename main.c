@@ -4,14 +4,120 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include "phil_error.h"
 #include "spawn_window.h"
 
+/* Print usage and exit */
+static void usage(const char *progName)
+{
+	fprintf(stderr, "Usage: %s [-f load|receipt] [-t milliseconds] [-r trace] [-s size] [-c] [-l]\n"
+		"       [-p megabytes] [-m megabytes] [-k megabytes] [-w passes] [-i] [-e]\n", progName);
+	fprintf(stderr, "  -f  send XdndFinished after the dropped state has loaded (load),\n"
+			"      or as soon as the data has been received (receipt, default)\n"
+			"  -t  give up on an XDND exchange whose peer has not answered\n"
+			"      within this many milliseconds (default 5000)\n"
+			"  -r  record handled events to trace.Phil and trace.Stuart,\n"
+			"      for replay with xdnd_replay\n"
+			"  -s  make each window this many pixels square (default 200)\n"
+			"  -c  draw with core X requests rather than a client-side image\n"
+			"  -l  write out dragged state only once the target asks for it,\n"
+			"      rather than as soon as the drag starts\n"
+			"  -p  pad dragged state with this many megabytes of preview data\n"
+			"  -m  offer the square as a MIDI file of this many megabytes too,\n"
+			"      streamed to targets that take audio/midi\n"
+			"  -k  keep up to this many megabytes of dropped content, so the\n"
+			"      same square dropped again needn't be sent (default 64)\n"
+			"  -w  draw each frame this many times over, to make a heavy scene\n"
+			"      (default 1)\n"
+			"  -i  draw on the event loop's thread, rather than a render thread\n"
+			"      with its own connection\n"
+			"  -e  fetch a drag's data while it hovers over us, so the drop\n"
+			"      lands at once\n");
+	exit(EXIT_FAILURE);
+}
+
 /* Entry point */
-int main(void)
+int main(int argc, char **argv)
 {
 	// Variables
 	pid_t procId;
+	int opt;
+	SpawnOptions options = {
+		.finishAfterLoad = false,
+		.timeoutMs = 5000,
+		.tracePath = NULL,
+		.windowSize = 200,
+		.coreDrawing = false,
+		.lazyPayload = false,
+		.previewMegabytes = 0,
+		.midiMegabytes = 0,
+		.cacheMegabytes = 64,
+		.scenePasses = 1,
+		.inlineRendering = false,
+		.prefetchDrops = false
+	};
+
+	// Parse options
+	while ((opt = getopt(argc, argv, "f:t:r:s:clp:m:k:w:ie")) != -1) {
+		switch (opt) {
+		case 'f':
+			if (strcmp(optarg, "load") == 0)
+				options.finishAfterLoad = true;
+			else if (strcmp(optarg, "receipt") == 0)
+				options.finishAfterLoad = false;
+			else
+				usage(argv[0]);
+			break;
+		case 't':
+			options.timeoutMs = atoi(optarg);
+			if (options.timeoutMs <= 0)
+				usage(argv[0]);
+			break;
+		case 'r':
+			options.tracePath = optarg;
+			break;
+		case 's':
+			options.windowSize = atoi(optarg);
+			if (options.windowSize < 50)
+				usage(argv[0]);
+			break;
+		case 'c':
+			options.coreDrawing = true;
+			break;
+		case 'l':
+			options.lazyPayload = true;
+			break;
+		case 'p':
+			options.previewMegabytes = atoi(optarg);
+			if (options.previewMegabytes < 0)
+				usage(argv[0]);
+			break;
+		case 'm':
+			options.midiMegabytes = atoi(optarg);
+			if (options.midiMegabytes < 0)
+				usage(argv[0]);
+			break;
+		case 'k':
+			options.cacheMegabytes = atoi(optarg);
+			if (options.cacheMegabytes < 0)
+				usage(argv[0]);
+			break;
+		case 'w':
+			options.scenePasses = atoi(optarg);
+			if (options.scenePasses <= 0)
+				usage(argv[0]);
+			break;
+		case 'i':
+			options.inlineRendering = true;
+			break;
+		case 'e':
+			options.prefetchDrops = true;
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
 
 	// Fork
 	switch (procId = fork()) {
@@ -20,9 +126,9 @@ int main(void)
 		philError("fork");
 	case 0:
 		// Child process
-		spawnWindow(procId);
+		spawnWindow(procId, &options);
 	default:
 		// Parent process
-		spawnWindow(procId);
+		spawnWindow(procId, &options);
 	}
 }
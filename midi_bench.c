@@ -0,0 +1,132 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This times how soon a target sees the first event of a dragged MIDI file, and how fast
+ * it gets through the whole thing, when each chunk is parsed as it arrives compared to
+ * when the file is collected in full and parsed afterwards. Chunks are the size the source
+ * puts in each INCR property, and the producer runs in step with the parser, as it does
+ * when the source fills each property on demand. The X round trip per chunk isn't timed */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "midi_stream.h"
+#include "phil_error.h"
+
+/* Print usage and exit */
+static void usage(const char *progName)
+{
+	fprintf(stderr, "Usage: %s [-m megabytes] [-k kilobytes] [-n rounds]\n", progName);
+	fprintf(stderr, "  -m  size of each MIDI file, in megabytes (default 16)\n"
+			"  -k  chunk size, in kilobytes (default 256)\n"
+			"  -n  parse this many files each way (default 5)\n");
+	exit(EXIT_FAILURE);
+}
+
+/* Nanoseconds from the monotonic clock */
+static uint64_t nowNs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* This produces and parses one file, returning the total time and time to first event */
+static uint64_t parseOnce(unsigned long notes, unsigned char *buffer, size_t chunkBytes,
+	size_t fileBytes, bool streamed, uint64_t *firstEventNs)
+{
+	MidiProducer producer;
+	MidiParser parser;
+	size_t collected = 0, length;
+	uint64_t start = nowNs();
+
+	initMidiProducer(&producer, 1, notes);
+	initMidiParser(&parser);
+	*firstEventNs = 0;
+
+	// Either parse each chunk as it comes, or collect them all first
+	while ((length = produceMidiChunk(&producer, buffer + (streamed ? 0 : collected),
+		streamed ? chunkBytes : fileBytes - collected < chunkBytes ?
+		fileBytes - collected : chunkBytes)) > 0) {
+		if (!streamed) {
+			collected += length;
+			continue;
+		}
+		feedMidiParser(&parser, buffer, length);
+		if (*firstEventNs == 0 && parser.events > 0)
+			*firstEventNs = nowNs() - start;
+	}
+	if (!streamed) {
+		for (size_t offset = 0; offset < collected; offset += chunkBytes) {
+			feedMidiParser(&parser, buffer + offset,
+				collected - offset < chunkBytes ? collected - offset : chunkBytes);
+			if (*firstEventNs == 0 && parser.events > 0)
+				*firstEventNs = nowNs() - start;
+		}
+	}
+	uint64_t totalNs = nowNs() - start;
+
+	// Program change, tempo, two ends of track and the notes themselves
+	if (parser.state != ParseComplete || parser.program != 1 || parser.events != notes + 4)
+		philError("midi_bench: parsed %lu events, expected %lu", parser.events, notes + 4);
+	return totalNs;
+}
+
+/* Entry point */
+int main(int argc, char **argv)
+{
+	// Variables
+	int opt, megabytes = 16, kilobytes = 256, rounds = 5;
+	const char *names[] = { "streamed", "whole" };
+
+	// Parse options
+	while ((opt = getopt(argc, argv, "m:k:n:")) != -1) {
+		switch (opt) {
+		case 'm':
+			megabytes = atoi(optarg);
+			if (megabytes <= 0)
+				usage(argv[0]);
+			break;
+		case 'k':
+			kilobytes = atoi(optarg);
+			if (kilobytes <= 0)
+				usage(argv[0]);
+			break;
+		case 'n':
+			rounds = atoi(optarg);
+			if (rounds <= 0)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc)
+		usage(argv[0]);
+
+	unsigned long notes = (unsigned long)megabytes * 1024 * 1024 / 4;
+	size_t fileBytes = getMidiFileSize(notes), chunkBytes = (size_t)kilobytes * 1024;
+	unsigned char *buffer = malloc(fileBytes);
+	if (!buffer)
+		philError("malloc");
+
+	printf("%zu byte files, %zu byte chunks, %d per way\n", fileBytes, chunkBytes, rounds);
+	printf("%-10s %14s %12s %12s\n", "parse", "first ev ms", "total ms", "MB/s");
+	for (int way = 0; way < 2; ++way) {
+		uint64_t totalNs = 0, firstNs = 0;
+
+		for (int round = 0; round < rounds; ++round) {
+			uint64_t firstEventNs;
+			totalNs += parseOnce(notes, buffer, chunkBytes, fileBytes, way == 0,
+				&firstEventNs);
+			firstNs += firstEventNs;
+		}
+
+		double meanMs = totalNs / 1e6 / rounds;
+		printf("%-10s %14.3f %12.3f %12.1f\n", names[way], firstNs / 1e6 / rounds, meanMs,
+			fileBytes / 1048576.0 / (meanMs / 1e3));
+	}
+
+	free(buffer);
+	return EXIT_SUCCESS;
+}
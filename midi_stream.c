@@ -0,0 +1,374 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This produces and parses Standard MIDI Files a piece at a time, so the square can be
+ * dragged as audio/midi and streamed through an INCR selection transfer.
+ *
+ * The producer writes a format 1 file with a conductor track and a note track, whose
+ * first event is a program change carrying the square's colour. It only ever holds one
+ * event, so a file of any size costs the source nothing until a chunk is asked for.
+ *
+ * The parser is a byte at a time state machine. It takes the file in whatever pieces the
+ * transfer delivers, with events and chunk headers split across them anywhere, and counts
+ * events as soon as their last byte arrives - the target needn't wait for a whole track */
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "midi_stream.h"
+
+// Producer stages
+enum {
+	ProduceHeader = 0,
+	ProduceNotes,
+	ProduceEndOfTrack,
+	ProduceDone
+};
+
+// Header chunk, conductor track and note track header, up to the note track length
+static const unsigned char midiFileStart[] = {
+	'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1, 0, 2, 0x01, 0xE0,
+	'M', 'T', 'r', 'k', 0, 0, 0, 11,
+	0x00, 0xFF, 0x51, 0x03, 0x07, 0xA1, 0x20,
+	0x00, 0xFF, 0x2F, 0x00,
+	'M', 'T', 'r', 'k'
+};
+static const unsigned char endOfTrack[] = { 0x00, 0xFF, 0x2F, 0x00 };
+
+// Every note event is a one byte delta and an explicit three byte status
+#define MIDI_NOTE_BYTES 4
+#define MIDI_PROGRAM_BYTES 3
+
+// This writes a big endian 32 bit value
+static void putBigEndian32(unsigned char *bytes, uint32_t value)
+{
+	bytes[0] = value >> 24;
+	bytes[1] = value >> 16;
+	bytes[2] = value >> 8;
+	bytes[3] = value;
+}
+
+// This reads a big endian 32 bit value
+static uint32_t getBigEndian32(const unsigned char *bytes)
+{
+	return ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) |
+		((uint32_t)bytes[2] << 8) | bytes[3];
+}
+
+// This sets up a producer for a file with the given program and number of note events
+void initMidiProducer(MidiProducer *producer, int program, unsigned long numberOfNotes)
+{
+	memset(producer, 0, sizeof(*producer));
+	producer->program = program & 0x7F;
+	producer->numberOfNotes = numberOfNotes;
+	producer->stage = ProduceHeader;
+	producer->totalBytes = getMidiFileSize(numberOfNotes);
+}
+
+// This gives the size of the file a producer will make, so the source can announce it
+size_t getMidiFileSize(unsigned long numberOfNotes)
+{
+	return sizeof(midiFileStart) + 4 + MIDI_PROGRAM_BYTES +
+		(size_t)numberOfNotes * MIDI_NOTE_BYTES + sizeof(endOfTrack);
+}
+
+// This writes the next note event - they alternate note on and note off, walking up two
+// octaves from middle C
+static void writeMidiNote(MidiProducer *producer, unsigned char *bytes)
+{
+	unsigned long note = producer->nextNote++;
+	bool on = (note % 2) == 0;
+
+	bytes[0] = on ? 0x00 : 0x60;
+	bytes[1] = on ? 0x90 : 0x80;
+	bytes[2] = 60 + (note / 2) % 24;
+	bytes[3] = 0x40;
+	if (producer->nextNote == producer->numberOfNotes)
+		producer->stage = ProduceEndOfTrack;
+}
+
+// This builds the next piece of the file, returning false once there are none left
+static bool produceMidiPiece(MidiProducer *producer)
+{
+	unsigned char *piece = producer->piece;
+
+	if (producer->stage == ProduceDone)
+		return false;
+	producer->pieceOffset = 0;
+	switch (producer->stage) {
+	case ProduceHeader:
+		memcpy(piece, midiFileStart, sizeof(midiFileStart));
+		putBigEndian32(piece + sizeof(midiFileStart), MIDI_PROGRAM_BYTES +
+			producer->numberOfNotes * MIDI_NOTE_BYTES + sizeof(endOfTrack));
+		piece += sizeof(midiFileStart) + 4;
+		piece[0] = 0x00;
+		piece[1] = 0xC0;
+		piece[2] = producer->program;
+		producer->pieceLength = sizeof(midiFileStart) + 4 + MIDI_PROGRAM_BYTES;
+		producer->stage = producer->numberOfNotes ? ProduceNotes : ProduceEndOfTrack;
+		return true;
+	case ProduceNotes:
+		writeMidiNote(producer, piece);
+		producer->pieceLength = MIDI_NOTE_BYTES;
+		return true;
+	case ProduceEndOfTrack:
+		memcpy(piece, endOfTrack, sizeof(endOfTrack));
+		producer->pieceLength = sizeof(endOfTrack);
+		producer->stage = ProduceDone;
+		return true;
+	default:
+		return false;
+	}
+}
+
+// This fills up to size bytes of buffer with the next part of the file, returning how many
+// were written - zero means the file is finished
+size_t produceMidiChunk(MidiProducer *producer, unsigned char *buffer, size_t size)
+{
+	size_t written = 0;
+
+	while (written < size) {
+		// Whole notes go straight into the buffer
+		if (producer->pieceOffset == producer->pieceLength &&
+			producer->stage == ProduceNotes && size - written >= MIDI_NOTE_BYTES) {
+			writeMidiNote(producer, buffer + written);
+			written += MIDI_NOTE_BYTES;
+			continue;
+		}
+		if (producer->pieceOffset == producer->pieceLength && !produceMidiPiece(producer))
+			break;
+
+		size_t count = producer->pieceLength - producer->pieceOffset;
+		if (count > size - written)
+			count = size - written;
+		memcpy(buffer + written, producer->piece + producer->pieceOffset, count);
+		producer->pieceOffset += count;
+		written += count;
+	}
+
+	return written;
+}
+
+// This sets up a parser at the start of a file
+void initMidiParser(MidiParser *parser)
+{
+	memset(parser, 0, sizeof(*parser));
+	parser->state = ParseChunkHeader;
+	parser->program = -1;
+}
+
+// This moves to a new state with nothing collected yet
+static void enterState(MidiParser *parser, MidiParseState state)
+{
+	parser->state = state;
+	parser->value = 0;
+	parser->scratchLength = 0;
+}
+
+// This skips count bytes, then moves to the given state
+static void skipBytes(MidiParser *parser, uint32_t count, MidiParseState after)
+{
+	if (count == 0) {
+		enterState(parser, after);
+		return;
+	}
+	enterState(parser, ParseSkip);
+	parser->value = count;
+	parser->afterSkip = after;
+}
+
+// This finishes the current track, skipping whatever follows its end of track event
+static void endTrack(MidiParser *parser)
+{
+	uint32_t remaining = parser->chunkRemaining;
+
+	parser->inTrack = false;
+	parser->chunkRemaining = 0;
+	if (++parser->tracksDone == parser->numberOfTracks)
+		enterState(parser, ParseComplete);
+	else
+		skipBytes(parser, remaining, ParseChunkHeader);
+}
+
+// This gives the number of data bytes a channel message carries
+static int getChannelDataLength(unsigned char status)
+{
+	switch (status & 0xF0) {
+	case 0xC0:
+	case 0xD0:
+		return 1;
+	default:
+		return 2;
+	}
+}
+
+// This adds a byte to a variable length quantity, returning true when it's complete
+static bool addQuantityByte(MidiParser *parser, unsigned char byte)
+{
+	if (++parser->scratchLength > 4) {
+		parser->state = ParseError;
+		return false;
+	}
+	parser->value = (parser->value << 7) | (byte & 0x7F);
+	return (byte & 0x80) == 0;
+}
+
+// This handles a chunk header once all eight bytes are in
+static void startChunk(MidiParser *parser)
+{
+	uint32_t length = getBigEndian32(parser->scratch + 4);
+
+	if (parser->numberOfTracks == 0) {
+		// The header chunk has to come first
+		if (memcmp(parser->scratch, "MThd", 4) != 0 || length < 6) {
+			parser->state = ParseError;
+			return;
+		}
+		parser->chunkRemaining = length;
+		enterState(parser, ParseHeader);
+	} else if (memcmp(parser->scratch, "MTrk", 4) == 0) {
+		parser->inTrack = true;
+		parser->chunkRemaining = length;
+		parser->runningStatus = 0;
+		parser->endOfTrack = false;
+		if (length == 0)
+			endTrack(parser);
+		else
+			enterState(parser, ParseDelta);
+	} else {
+		// Unknown chunks are allowed, and ignored
+		skipBytes(parser, length, ParseChunkHeader);
+	}
+}
+
+// This checks for a one byte delta followed by a complete two byte channel message, with
+// its status given explicitly
+static bool isWholeChannelEvent(const unsigned char *bytes)
+{
+	return bytes[0] < 0x80 && bytes[1] >= 0x80 && bytes[1] < 0xF0 &&
+		getChannelDataLength(bytes[1]) == 2 && bytes[2] < 0x80 && bytes[3] < 0x80;
+}
+
+// This handles one byte, in whatever state the parser is in
+static void parseByte(MidiParser *parser, unsigned char byte)
+{
+	switch (parser->state) {
+	case ParseChunkHeader:
+		parser->scratch[parser->scratchLength++] = byte;
+		if (parser->scratchLength == 8)
+			startChunk(parser);
+		break;
+	case ParseHeader:
+		parser->scratch[parser->scratchLength++] = byte;
+		if (parser->scratchLength == 6) {
+			parser->numberOfTracks = (parser->scratch[2] << 8) | parser->scratch[3];
+			if (parser->numberOfTracks == 0)
+				enterState(parser, ParseComplete);
+			else
+				skipBytes(parser, parser->chunkRemaining - 6, ParseChunkHeader);
+		}
+		break;
+	case ParseDelta:
+		if (addQuantityByte(parser, byte))
+			enterState(parser, ParseStatus);
+		break;
+	case ParseStatus:
+		if (byte == 0xFF) {
+			parser->runningStatus = 0;
+			enterState(parser, ParseMetaType);
+		} else if (byte == 0xF0 || byte == 0xF7) {
+			parser->runningStatus = 0;
+			enterState(parser, ParseSysexLength);
+		} else if (byte >= 0xF0) {
+			parser->state = ParseError;
+		} else if (byte & 0x80) {
+			parser->runningStatus = byte;
+			parser->dataNeeded = getChannelDataLength(byte);
+			enterState(parser, ParseData);
+		} else if (parser->runningStatus == 0) {
+			parser->state = ParseError;
+		} else {
+			// Running status - this is already the first data byte
+			parser->dataNeeded = getChannelDataLength(parser->runningStatus);
+			enterState(parser, ParseData);
+			parseByte(parser, byte);
+		}
+		break;
+	case ParseData:
+		parser->scratch[parser->scratchLength++] = byte;
+		if (parser->scratchLength == parser->dataNeeded) {
+			parser->events++;
+			if ((parser->runningStatus & 0xF0) == 0xC0 && parser->program < 0)
+				parser->program = parser->scratch[0];
+			enterState(parser, ParseDelta);
+		}
+		break;
+	case ParseMetaType:
+		parser->metaType = byte;
+		enterState(parser, ParseMetaLength);
+		break;
+	case ParseMetaLength:
+		if (addQuantityByte(parser, byte)) {
+			parser->events++;
+			parser->endOfTrack = parser->metaType == 0x2F;
+			skipBytes(parser, parser->value, ParseDelta);
+		}
+		break;
+	case ParseSysexLength:
+		if (addQuantityByte(parser, byte)) {
+			parser->events++;
+			skipBytes(parser, parser->value, ParseDelta);
+		}
+		break;
+	default:
+		break;
+	}
+}
+
+// This feeds the next bytes of the file to the parser, returning the state it's left in -
+// ParseComplete once every track has ended, or ParseError if the file is malformed
+MidiParseState feedMidiParser(MidiParser *parser, const unsigned char *bytes, size_t length)
+{
+	size_t i = 0;
+
+	while (i < length && parser->state != ParseComplete && parser->state != ParseError) {
+		size_t count = 1;
+		bool inTrack = parser->inTrack;
+
+		if (parser->inTrack && parser->chunkRemaining == 0) {
+			// A track ran out without an end of track event
+			endTrack(parser);
+			continue;
+		}
+
+		if (parser->state == ParseDelta && parser->scratchLength == 0 &&
+			length - i >= 4 && parser->chunkRemaining >= 4 &&
+			isWholeChannelEvent(bytes + i)) {
+			// The common case - a one byte delta and a whole two byte channel message
+			parser->runningStatus = bytes[i + 1];
+			parser->events++;
+			count = 4;
+		} else if (parser->state == ParseSkip) {
+			// Skip as much as this piece holds in one go
+			count = length - i;
+			if (count > parser->value)
+				count = parser->value;
+			if (parser->inTrack && count > parser->chunkRemaining)
+				count = parser->chunkRemaining;
+			parser->value -= count;
+			if (parser->value == 0)
+				enterState(parser, parser->afterSkip);
+		} else {
+			parseByte(parser, bytes[i]);
+		}
+		i += count;
+		parser->bytes += count;
+
+		// Chunk headers don't count towards the track they start
+		if (inTrack && parser->inTrack) {
+			parser->chunkRemaining -= count;
+			if (parser->state == ParseDelta && (parser->endOfTrack || parser->chunkRemaining == 0))
+				endTrack(parser);
+		}
+	}
+
+	return parser->state;
+}
@@ -0,0 +1,64 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for streaming Standard MIDI Files */
+#ifndef MIDI_STREAM
+#define MIDI_STREAM
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Producer structure - generates a two track file a piece at a time, so it never has to
+// exist in full
+typedef struct {
+	int program;
+	unsigned long numberOfNotes;
+	unsigned long nextNote;
+	int stage;
+	unsigned char piece[64];
+	size_t pieceLength;
+	size_t pieceOffset;
+	size_t totalBytes;
+} MidiProducer;
+
+// Where the parser is within the file
+typedef enum {
+	ParseChunkHeader = 0,
+	ParseHeader,
+	ParseDelta,
+	ParseStatus,
+	ParseData,
+	ParseMetaType,
+	ParseMetaLength,
+	ParseSysexLength,
+	ParseSkip,
+	ParseComplete,
+	ParseError
+} MidiParseState;
+
+// Parser structure - takes bytes in whatever pieces they arrive in
+typedef struct {
+	MidiParseState state;
+	unsigned char scratch[8];
+	int scratchLength;
+	bool inTrack;
+	uint32_t chunkRemaining;
+	uint32_t value;
+	int numberOfTracks;
+	int tracksDone;
+	unsigned char runningStatus;
+	unsigned char metaType;
+	int dataNeeded;
+	bool endOfTrack;
+	MidiParseState afterSkip;
+	int program;
+	unsigned long events;
+	size_t bytes;
+} MidiParser;
+
+void initMidiProducer(MidiProducer *producer, int program, unsigned long numberOfNotes);
+size_t getMidiFileSize(unsigned long numberOfNotes);
+size_t produceMidiChunk(MidiProducer *producer, unsigned char *buffer, size_t size);
+void initMidiParser(MidiParser *parser);
+MidiParseState feedMidiParser(MidiParser *parser, const unsigned char *bytes, size_t length);
+
+#endif
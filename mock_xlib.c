@@ -0,0 +1,620 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This stands in for libX11 when replaying traces, so the handlers can run offline at
+ * full speed. Only the calls the handlers make are provided - it is linked instead of
+ * -lX11, so anything missing shows up as a link error. Nothing is drawn and nothing is
+ * sent; instead each call is counted as a round trip or a one-way request. Every window
+ * claims to be XdndAware with no children, and the dropped data always points at the
+ * path given to setMockSelectionPath(). The screen is 24 bit TrueColor without MIT-SHM,
+ * ARGB visuals or the shape extension, so the renderer draws into a plain image and
+ * presents it with XPutImage, and the drag icon is a plain opaque window. Requests are
+ * numbered as Xlib numbers them, and once setMockPeersVanished() is called, anything sent
+ * to or asked of another window fails with BadWindow through the installed error handler,
+ * as if the peer had been destroyed. XOpenDisplay gives a second display on the same
+ * screen for the render thread - its requests are numbered but not counted, so the counts
+ * are only what the handlers asked for */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/Xatom.h>
+#include <X11/keysym.h>
+#include <X11/Xproto.h>
+#include <X11/extensions/XShm.h>
+#include <X11/extensions/shape.h>
+#include "mock_xlib.h"
+#include "phil_error.h"
+
+#define MAX_MOCK_ATOMS 256
+#define MOCK_XDND_VERSION 5
+#define MOCK_FIRST_WINDOW 0x7F000000
+
+// Registered atoms
+static struct {
+	Atom atom;
+	char *name;
+} atomRegistry[MAX_MOCK_ATOMS];
+static int numberOfAtoms;
+static Atom nextAtom = XA_LAST_PREDEFINED + 1;
+
+// Dropped data, statistics, and the display they are counted for
+static char *selectionPath;
+static MockXStats stats;
+static Display *countedDisplay;
+
+// Whether windows other than ours have gone, and who to tell about requests to them
+static bool peersVanished;
+static Window ownWindow;
+static XErrorHandler errorHandler;
+
+// Who is shown the events the handlers send
+static MockSendHook sendHook;
+
+// These count a one-way request or a round trip, numbering it as Xlib would
+static void countRequest(Display *disp)
+{
+	if (disp == countedDisplay)
+		stats.requests++;
+	((_XPrivDisplay)disp)->request++;
+}
+
+static void countRoundTrip(Display *disp)
+{
+	if (disp == countedDisplay)
+		stats.roundTrips++;
+	((_XPrivDisplay)disp)->request++;
+	((_XPrivDisplay)disp)->last_request_read = ((_XPrivDisplay)disp)->request;
+}
+
+// This fails the request just counted if it was for a window that has gone, returning
+// whether it did
+static bool failIfVanished(Display *disp, Window wind, unsigned char requestCode)
+{
+	if (!peersVanished || wind == None || wind == ownWindow || wind >= MOCK_FIRST_WINDOW)
+		return false;
+
+	XErrorEvent error = {
+		.type = 0,
+		.display = disp,
+		.resourceid = wind,
+		.serial = ((_XPrivDisplay)disp)->request,
+		.error_code = BadWindow,
+		.request_code = requestCode
+	};
+	stats.errors++;
+	if (errorHandler)
+		errorHandler(disp, &error);
+	return true;
+}
+
+// This creates a display with a single screen, which is all the handlers look at
+Display *createMockDisplay(Window root)
+{
+	_XPrivDisplay disp = calloc(1, sizeof(*disp));
+	Screen *screen = calloc(1, sizeof(*screen));
+	Visual *visual = calloc(1, sizeof(*visual));
+	if (!disp || !screen || !visual)
+		philError("calloc");
+
+	visual->class = TrueColor;
+	visual->red_mask = 0xFF0000;
+	visual->green_mask = 0xFF00;
+	visual->blue_mask = 0xFF;
+	visual->bits_per_rgb = 8;
+	screen->root = root;
+	screen->width = 1920;
+	screen->height = 1080;
+	screen->root_depth = 24;
+	screen->root_visual = visual;
+	disp->screens = screen;
+	disp->nscreens = 1;
+	disp->default_screen = 0;
+	disp->fd = -1;
+	if (!countedDisplay)
+		countedDisplay = (Display *)disp;
+
+	return (Display *)disp;
+}
+
+void destroyMockDisplay(Display *disp)
+{
+	if (disp == countedDisplay)
+		countedDisplay = NULL;
+	free(((_XPrivDisplay)disp)->screens->root_visual);
+	free(((_XPrivDisplay)disp)->screens);
+	free(disp);
+}
+
+// This makes XInternAtoms hand out the value the trace was recorded with
+void registerMockAtom(const char *name, Atom atom)
+{
+	if (numberOfAtoms == MAX_MOCK_ATOMS)
+		philError("registerMockAtom: too many atoms");
+	atomRegistry[numberOfAtoms].atom = atom;
+	atomRegistry[numberOfAtoms].name = strdup(name);
+	if (!atomRegistry[numberOfAtoms].name)
+		philError("strdup");
+	numberOfAtoms++;
+	if (atom >= nextAtom)
+		nextAtom = atom + 1;
+}
+
+void setMockSelectionPath(const char *pathStr)
+{
+	selectionPath = (char *)pathStr;
+}
+
+// This makes every window but our own and those we created fail requests, or brings them
+// back - the root too, as it is where the source finds its target
+void setMockPeersVanished(Window own, bool vanished)
+{
+	ownWindow = own;
+	peersVanished = vanished;
+}
+
+MockXStats *getMockXStats(void)
+{
+	return &stats;
+}
+
+// This has every event the handlers send shown to hook, until it is set back to NULL
+void setMockSendHook(MockSendHook hook)
+{
+	sendHook = hook;
+}
+
+// This finds an atom by name, returning None if it was never registered
+static Atom findAtom(const char *name)
+{
+	for (int i = 0; i < numberOfAtoms; ++i) {
+		if (strcmp(atomRegistry[i].name, name) == 0)
+			return atomRegistry[i].atom;
+	}
+
+	return None;
+}
+
+Status XInternAtoms(Display *disp, char **names, int count, Bool onlyIfExists, Atom *atomsReturn)
+{
+	countRoundTrip(disp);
+	for (int i = 0; i < count; ++i) {
+		atomsReturn[i] = findAtom(names[i]);
+		if (atomsReturn[i] == None && !onlyIfExists) {
+			atomsReturn[i] = nextAtom;
+			registerMockAtom(names[i], atomsReturn[i]);
+		}
+	}
+
+	return 1;
+}
+
+// This names an atom, in memory the caller frees with XFree
+static char *nameAtom(Atom atom)
+{
+	for (int i = 0; i < numberOfAtoms; ++i) {
+		if (atomRegistry[i].atom == atom)
+			return strdup(atomRegistry[i].name);
+	}
+
+	return strdup("UNKNOWN");
+}
+
+char *XGetAtomName(Display *disp, Atom atom)
+{
+	countRoundTrip(disp);
+	return nameAtom(atom);
+}
+
+Atom XInternAtom(Display *disp, const char *name, Bool onlyIfExists)
+{
+	Atom atom;
+
+	XInternAtoms(disp, (char **)&name, 1, onlyIfExists, &atom);
+	return atom;
+}
+
+Status XGetAtomNames(Display *disp, Atom *atoms, int count, char **namesReturn)
+{
+	countRoundTrip(disp);
+	for (int i = 0; i < count; ++i)
+		namesReturn[i] = nameAtom(atoms[i]);
+	return 1;
+}
+
+int XFree(void *data)
+{
+	free(data);
+	return 1;
+}
+
+int XGetWindowProperty(Display *disp, Window wind, Atom property, long offset, long length,
+	Bool delete, Atom reqType, Atom *actualTypeReturn, int *actualFormatReturn,
+	unsigned long *numOfItemsReturn, unsigned long *bytesAfterReturn, unsigned char **propReturn)
+{
+	countRoundTrip(disp);
+	*actualTypeReturn = None;
+	*actualFormatReturn = 0;
+	*numOfItemsReturn = 0;
+	*bytesAfterReturn = 0;
+	*propReturn = NULL;
+	if (failIfVanished(disp, wind, X_GetProperty))
+		return BadWindow;
+
+	if (property == findAtom("XdndAware")) {
+		// Every window speaks XDND
+		long *version = malloc(sizeof(long));
+		if (!version)
+			philError("malloc");
+		*version = MOCK_XDND_VERSION;
+		*actualTypeReturn = XA_ATOM;
+		*actualFormatReturn = 32;
+		*numOfItemsReturn = 1;
+		*propReturn = (unsigned char *)version;
+	} else if (property == findAtom("XDND_DATA") && selectionPath) {
+		// The dropped data is always our state file
+		size_t size = strlen("file://") + strlen(selectionPath) + 3;
+		char *data = malloc(size);
+		if (!data)
+			philError("malloc");
+		snprintf(data, size, "file://%s\r\n", selectionPath);
+		*actualTypeReturn = findAtom("text/uri-list");
+		*actualFormatReturn = 8;
+		*numOfItemsReturn = size - 1;
+		*propReturn = (unsigned char *)data;
+	}
+
+	return Success;
+}
+
+Status XQueryTree(Display *disp, Window wind, Window *rootReturn, Window *parentReturn,
+	Window **childrenReturn, unsigned int *numOfChildrenReturn)
+{
+	countRoundTrip(disp);
+	*rootReturn = DefaultRootWindow(disp);
+	*parentReturn = None;
+	*childrenReturn = NULL;
+	*numOfChildrenReturn = 0;
+
+	return 1;
+}
+
+Status XGetWindowAttributes(Display *disp, Window wind, XWindowAttributes *attrsReturn)
+{
+	countRoundTrip(disp);
+	memset(attrsReturn, 0, sizeof(*attrsReturn));
+
+	return 1;
+}
+
+Bool XQueryPointer(Display *disp, Window wind, Window *rootReturn, Window *childReturn,
+	int *rootXReturn, int *rootYReturn, int *winXReturn, int *winYReturn, unsigned int *maskReturn)
+{
+	countRoundTrip(disp);
+	*rootReturn = DefaultRootWindow(disp);
+	*childReturn = None;
+	*rootXReturn = *winXReturn = 100;
+	*rootYReturn = *winYReturn = 100;
+	*maskReturn = 0;
+
+	return True;
+}
+
+Bool XTranslateCoordinates(Display *disp, Window src, Window dest, int srcX, int srcY,
+	int *destXReturn, int *destYReturn, Window *childReturn)
+{
+	countRoundTrip(disp);
+	*destXReturn = srcX;
+	*destYReturn = srcY;
+	*childReturn = None;
+	return True;
+}
+
+Status XSendEvent(Display *disp, Window wind, Bool propagate, long eventMask, XEvent *event)
+{
+	countRequest(disp);
+	if (!failIfVanished(disp, wind, X_SendEvent) && sendHook)
+		sendHook(wind, event);
+	stats.sentEvents++;
+	return 1;
+}
+
+int XChangeProperty(Display *disp, Window wind, Atom property, Atom type, int format, int mode,
+	const unsigned char *data, int numOfElements)
+{
+	countRequest(disp);
+	failIfVanished(disp, wind, X_ChangeProperty);
+	return 1;
+}
+
+int XDeleteProperty(Display *disp, Window wind, Atom property)
+{
+	countRequest(disp);
+	failIfVanished(disp, wind, X_DeleteProperty);
+	return 1;
+}
+
+int XSelectInput(Display *disp, Window wind, long eventMask)
+{
+	countRequest(disp);
+	failIfVanished(disp, wind, X_ChangeWindowAttributes);
+	return 1;
+}
+
+long XMaxRequestSize(Display *disp)
+{
+	// The core protocol's limit, in four byte units
+	return 65535;
+}
+
+int XConvertSelection(Display *disp, Atom selection, Atom target, Atom property,
+	Window requestor, Time time)
+{
+	countRequest(disp);
+	return 1;
+}
+
+int XSetSelectionOwner(Display *disp, Atom selection, Window owner, Time time)
+{
+	countRequest(disp);
+	return 1;
+}
+
+Status XSetWMProtocols(Display *disp, Window wind, Atom *protocols, int count)
+{
+	countRequest(disp);
+	return 1;
+}
+
+int XClearWindow(Display *disp, Window wind)
+{
+	countRequest(disp);
+	return 1;
+}
+
+int XFillRectangle(Display *disp, Drawable d, GC gContext, int x, int y,
+	unsigned int width, unsigned int height)
+{
+	countRequest(disp);
+	return 1;
+}
+
+int XDrawRectangle(Display *disp, Drawable d, GC gContext, int x, int y,
+	unsigned int width, unsigned int height)
+{
+	countRequest(disp);
+	return 1;
+}
+
+int XSetForeground(Display *disp, GC gContext, unsigned long foreground)
+{
+	countRequest(disp);
+	return 1;
+}
+
+Display *XOpenDisplay(const char *displayName)
+{
+	return createMockDisplay(DefaultRootWindow(countedDisplay));
+}
+
+int XCloseDisplay(Display *disp)
+{
+	destroyMockDisplay(disp);
+	return 0;
+}
+
+GC XCreateGC(Display *disp, Drawable d, unsigned long valueMask, XGCValues *values)
+{
+	// Never looked inside, so anything that isn't NULL will do
+	static char gContext;
+
+	countRequest(disp);
+	return (GC)&gContext;
+}
+
+int XFreeGC(Display *disp, GC gContext)
+{
+	countRequest(disp);
+	return 1;
+}
+
+int XFlush(Display *disp)
+{
+	return 1;
+}
+
+int XSync(Display *disp, Bool discard)
+{
+	countRoundTrip(disp);
+	return 1;
+}
+
+XErrorHandler XSetErrorHandler(XErrorHandler handler)
+{
+	XErrorHandler oldHandler = errorHandler;
+	errorHandler = handler;
+	return oldHandler;
+}
+
+// This frees an image made by our XCreateImage
+static int destroyMockImage(XImage *image)
+{
+	free(image->data);
+	free(image);
+	return 1;
+}
+
+XImage *XCreateImage(Display *disp, Visual *visual, unsigned int depth, int format, int offset,
+	char *data, unsigned int width, unsigned int height, int bitmapPad, int bytesPerLine)
+{
+	XImage *image = calloc(1, sizeof(*image));
+	if (!image)
+		philError("calloc");
+
+	image->width = width;
+	image->height = height;
+	image->format = format;
+	image->data = data;
+	image->depth = depth;
+	image->bitmap_pad = bitmapPad;
+	image->bits_per_pixel = 32;
+	image->bytes_per_line = bytesPerLine ? bytesPerLine : width * 4;
+	image->f.destroy_image = destroyMockImage;
+
+	return image;
+}
+
+int XPutImage(Display *disp, Drawable d, GC gContext, XImage *image, int srcX, int srcY,
+	int destX, int destY, unsigned int width, unsigned int height)
+{
+	countRequest(disp);
+	return 1;
+}
+
+Bool XShmQueryExtension(Display *disp)
+{
+	countRoundTrip(disp);
+	return False;
+}
+
+XImage *XShmCreateImage(Display *disp, Visual *visual, unsigned int depth, int format,
+	char *data, XShmSegmentInfo *shmInfo, unsigned int width, unsigned int height)
+{
+	return NULL;
+}
+
+Bool XShmAttach(Display *disp, XShmSegmentInfo *shmInfo)
+{
+	countRequest(disp);
+	return False;
+}
+
+Bool XShmDetach(Display *disp, XShmSegmentInfo *shmInfo)
+{
+	countRequest(disp);
+	return False;
+}
+
+Bool XShmPutImage(Display *disp, Drawable d, GC gContext, XImage *image, int srcX, int srcY,
+	int destX, int destY, unsigned int width, unsigned int height, Bool sendEvent)
+{
+	countRequest(disp);
+	return False;
+}
+
+Window XCreateWindow(Display *disp, Window parent, int x, int y, unsigned int width,
+	unsigned int height, unsigned int borderWidth, int depth, unsigned int windowClass,
+	Visual *visual, unsigned long valueMask, XSetWindowAttributes *attrs)
+{
+	static Window nextWindow = MOCK_FIRST_WINDOW;
+
+	countRequest(disp);
+	return nextWindow++;
+}
+
+int XDestroyWindow(Display *disp, Window wind)
+{
+	countRequest(disp);
+	return 1;
+}
+
+int XMapRaised(Display *disp, Window wind)
+{
+	countRequest(disp);
+	return 1;
+}
+
+int XUnmapWindow(Display *disp, Window wind)
+{
+	countRequest(disp);
+	return 1;
+}
+
+int XMoveWindow(Display *disp, Window wind, int x, int y)
+{
+	countRequest(disp);
+	return 1;
+}
+
+int XSetWindowBackground(Display *disp, Window wind, unsigned long pixel)
+{
+	countRequest(disp);
+	return 1;
+}
+
+Status XMatchVisualInfo(Display *disp, int screen, int depth, int visualClass,
+	XVisualInfo *visualInfo)
+{
+	return 0;
+}
+
+Colormap XCreateColormap(Display *disp, Window wind, Visual *visual, int alloc)
+{
+	countRequest(disp);
+	return 1;
+}
+
+int XFreeColormap(Display *disp, Colormap colormap)
+{
+	countRequest(disp);
+	return 1;
+}
+
+Bool XShapeQueryExtension(Display *disp, int *eventBase, int *errorBase)
+{
+	countRoundTrip(disp);
+	return False;
+}
+
+Status XShapeQueryVersion(Display *disp, int *major, int *minor)
+{
+	countRoundTrip(disp);
+	return 0;
+}
+
+void XShapeCombineRectangles(Display *disp, Window dest, int destKind, int xOff, int yOff,
+	XRectangle *rects, int count, int op, int ordering)
+{
+	countRequest(disp);
+}
+
+int XDisplayKeycodes(Display *disp, int *minKeycodes, int *maxKeycodes)
+{
+	*minKeycodes = 8;
+	*maxKeycodes = 255;
+	return 1;
+}
+
+// A US layout as far as the bindings care - Escape, Control_L, 'a' and Shift_L
+KeySym *XGetKeyboardMapping(Display *disp, KeyCode firstKeycode, int count,
+	int *keysymsPerKeycode)
+{
+	KeySym *keysyms = calloc(count * 2, sizeof(KeySym));
+	if (!keysyms)
+		philError("calloc");
+
+	countRoundTrip(disp);
+	for (int i = 0; i < count; ++i) {
+		switch (firstKeycode + i) {
+		case 9:
+			keysyms[i * 2] = XK_Escape;
+			break;
+		case 37:
+			keysyms[i * 2] = XK_Control_L;
+			break;
+		case 38:
+			keysyms[i * 2] = XK_a;
+			keysyms[i * 2 + 1] = XK_A;
+			break;
+		case 50:
+			keysyms[i * 2] = XK_Shift_L;
+			break;
+		}
+	}
+	*keysymsPerKeycode = 2;
+	return keysyms;
+}
+
+int XRefreshKeyboardMapping(XMappingEvent *event)
+{
+	return 1;
+}
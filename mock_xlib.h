@@ -0,0 +1,28 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for the mock X connection used by trace replay */
+#ifndef MOCK_XLIB
+#define MOCK_XLIB
+
+#include <stdbool.h>
+#include <X11/Xlib.h>
+
+// Counts of what the handlers asked the X server to do
+typedef struct {
+	unsigned long roundTrips;
+	unsigned long requests;
+	unsigned long sentEvents;
+	unsigned long errors;
+} MockXStats;
+
+// Called with every event the handlers send, and the window it was sent to
+typedef void (*MockSendHook)(Window wind, XEvent *event);
+
+Display *createMockDisplay(Window root);
+void destroyMockDisplay(Display *disp);
+void registerMockAtom(const char *name, Atom atom);
+void setMockSelectionPath(const char *pathStr);
+void setMockPeersVanished(Window own, bool vanished);
+MockXStats *getMockXStats(void);
+void setMockSendHook(MockSendHook hook);
+
+#endif
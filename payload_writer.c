@@ -0,0 +1,116 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This serializes the square we are dragging on a worker thread as soon as a drag
+ * starts, so when the target asks for the data all that is left is the property write.
+ * If the square changes mid-drag the payload is invalidated and written again, and if it
+ * is somehow still not right when asked for, it is written there and then as before.
+ *
+ * Every payload goes in a file of its own, which we remove once a newer one replaces it.
+ * A target that moves the payload takes the file over instead, and releasePayload() makes
+ * us forget it */
+#include <stdio.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "payload_writer.h"
+#include "square_state.h"
+#include "phil_error.h"
+
+// This is the worker thread body - the square was copied when the write started, so
+// the event loop is free to change its own
+static void *payloadWriterThread(void *arg)
+{
+	PayloadWriter *writer = arg;
+
+	saveSquareState(&writer->writtenSquare, writer->pathStr, writer->previewBytes);
+	return NULL;
+}
+
+// This waits for any write in flight
+static void joinPayloadWrite(PayloadWriter *writer)
+{
+	if (!writer->busy)
+		return;
+
+	if (pthread_join(writer->thread, NULL) != 0)
+		philError("pthread_join");
+	writer->busy = false;
+}
+
+// This removes the file we last wrote, if it is still ours, and picks a name for the next
+static void nextPayloadPath(PayloadWriter *writer, Square *square)
+{
+	if (writer->owned)
+		unlink(writer->pathStr);
+
+	snprintf(writer->pathStr, sizeof(writer->pathStr), "/tmp/square.%d.%lu.state",
+		(int)getpid(), ++writer->generation);
+	writer->writtenSquare = *square;
+	writer->valid = true;
+	writer->owned = true;
+}
+
+// This sets the writer up with nothing written, padding payloads with preview data
+void initPayloadWriter(PayloadWriter *writer, size_t previewBytes)
+{
+	writer->busy = false;
+	writer->valid = false;
+	writer->owned = false;
+	writer->generation = 0;
+	writer->previewBytes = previewBytes;
+	writer->hits = 0;
+	writer->misses = 0;
+}
+
+// This starts writing the square in the background, unless it is already written
+void startPayloadWrite(PayloadWriter *writer, Square *square)
+{
+	if (writer->valid && writer->writtenSquare.colour == square->colour)
+		return;
+
+	// Let any earlier write finish before its file goes
+	joinPayloadWrite(writer);
+
+	nextPayloadPath(writer, square);
+	writer->busy = true;
+	if (pthread_create(&writer->thread, NULL, payloadWriterThread, writer) != 0)
+		philError("pthread_create");
+}
+
+// This forgets the written payload, as the square no longer matches it
+void invalidatePayload(PayloadWriter *writer)
+{
+	writer->valid = false;
+}
+
+// This forgets the written payload without removing it, as a target has moved it away
+void releasePayload(PayloadWriter *writer)
+{
+	joinPayloadWrite(writer);
+	writer->valid = false;
+	writer->owned = false;
+}
+
+// This returns the path of a payload matching the square, waiting for the write in flight
+// if need be, or writing it here if the square has changed since
+const char *getPayload(PayloadWriter *writer, Square *square)
+{
+	joinPayloadWrite(writer);
+
+	if (writer->valid && writer->writtenSquare.colour == square->colour) {
+		writer->hits++;
+		return writer->pathStr;
+	}
+
+	writer->misses++;
+	nextPayloadPath(writer, square);
+	saveSquareState(square, writer->pathStr, writer->previewBytes);
+	return writer->pathStr;
+}
+
+// This waits for any outstanding write, and removes the file if it is still ours
+void destroyPayloadWriter(PayloadWriter *writer)
+{
+	joinPayloadWrite(writer);
+	if (writer->owned)
+		unlink(writer->pathStr);
+}
@@ -0,0 +1,33 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for the background payload writer */
+#ifndef PAYLOAD_WRITER
+#define PAYLOAD_WRITER
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "square_state.h"
+
+// Payload writer structure - one write in flight at a time, for the square as it was when
+// the write started
+typedef struct {
+	pthread_t thread;
+	bool busy;
+	bool valid;
+	bool owned;
+	Square writtenSquare;
+	char pathStr[64];
+	unsigned long generation;
+	size_t previewBytes;
+	unsigned long hits;
+	unsigned long misses;
+} PayloadWriter;
+
+void initPayloadWriter(PayloadWriter *writer, size_t previewBytes);
+void startPayloadWrite(PayloadWriter *writer, Square *square);
+void invalidatePayload(PayloadWriter *writer);
+void releasePayload(PayloadWriter *writer);
+const char *getPayload(PayloadWriter *writer, Square *square);
+void destroyPayloadWriter(PayloadWriter *writer);
+
+#endif
@@ -0,0 +1,284 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This is a small software rasterizer for the client-side frame - solid rectangles,
+ * alpha blended rectangles and blits, all clipped to the target. Each operation is
+ * clipped once here, and then handed row by row to a span function for the chosen code
+ * path. On x86 the SSE2 and AVX2 paths are compiled in regardless of the build flags and
+ * picked at runtime from what the CPU supports; everywhere else only the scalar path
+ * exists. Every path produces the same pixels */
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include "raster.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define RASTER_X86
+#include <immintrin.h>
+#endif
+
+// Span functions for one code path
+typedef struct {
+	void (*fillSpan)(uint32_t *dest, int count, uint32_t pixel);
+	void (*blendSpan)(uint32_t *dest, int count, uint32_t pixel, uint32_t alpha);
+	void (*copySpan)(uint32_t *dest, const uint32_t *src, int count);
+} RasterSpans;
+
+// This blends one pixel, dividing by 255 with rounding the same way the vector paths do
+static uint32_t blendPixel(uint32_t dest, uint32_t pixel, uint32_t alpha)
+{
+	uint32_t inverse = 255 - alpha;
+	uint32_t rb = (pixel & 0xFF00FF) * alpha + (dest & 0xFF00FF) * inverse + 0x800080;
+	uint32_t g = (pixel & 0xFF00) * alpha + (dest & 0xFF00) * inverse + 0x8000;
+
+	rb = ((rb + ((rb >> 8) & 0xFF00FF)) >> 8) & 0xFF00FF;
+	g = ((g + ((g >> 8) & 0xFF00)) >> 8) & 0xFF00;
+	return rb | g;
+}
+
+// Scalar spans
+static void fillSpanScalar(uint32_t *dest, int count, uint32_t pixel)
+{
+	for (int i = 0; i < count; ++i)
+		dest[i] = pixel;
+}
+
+static void blendSpanScalar(uint32_t *dest, int count, uint32_t pixel, uint32_t alpha)
+{
+	for (int i = 0; i < count; ++i)
+		dest[i] = blendPixel(dest[i], pixel, alpha);
+}
+
+static void copySpanScalar(uint32_t *dest, const uint32_t *src, int count)
+{
+	for (int i = 0; i < count; ++i)
+		dest[i] = src[i];
+}
+
+#ifdef RASTER_X86
+// SSE2 spans, four pixels at a time
+__attribute__((target("sse2")))
+static void fillSpanSSE2(uint32_t *dest, int count, uint32_t pixel)
+{
+	__m128i pixels = _mm_set1_epi32(pixel);
+	int i = 0;
+
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_si128((__m128i *)(dest + i), pixels);
+	fillSpanScalar(dest + i, count - i, pixel);
+}
+
+// Each channel is widened to 16 bits, so dest * (255 - alpha) + pixel * alpha + 128 fits
+__attribute__((target("sse2")))
+static __m128i blendChannelsSSE2(__m128i dest, __m128i inverse, __m128i pixelTerm)
+{
+	__m128i sum = _mm_add_epi16(_mm_mullo_epi16(dest, inverse), pixelTerm);
+	return _mm_srli_epi16(_mm_add_epi16(sum, _mm_srli_epi16(sum, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+static void blendSpanSSE2(uint32_t *dest, int count, uint32_t pixel, uint32_t alpha)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i inverse = _mm_set1_epi16(255 - alpha);
+	__m128i pixelTerm = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(
+		_mm_set1_epi32(pixel & 0xFFFFFF), zero), _mm_set1_epi16(alpha)), _mm_set1_epi16(128));
+	__m128i rgbMask = _mm_set1_epi32(0xFFFFFF);
+	int i = 0;
+
+	for (; i + 4 <= count; i += 4) {
+		__m128i pixels = _mm_loadu_si128((__m128i *)(dest + i));
+		__m128i low = blendChannelsSSE2(_mm_unpacklo_epi8(pixels, zero), inverse, pixelTerm);
+		__m128i high = blendChannelsSSE2(_mm_unpackhi_epi8(pixels, zero), inverse, pixelTerm);
+		_mm_storeu_si128((__m128i *)(dest + i),
+			_mm_and_si128(_mm_packus_epi16(low, high), rgbMask));
+	}
+	blendSpanScalar(dest + i, count - i, pixel, alpha);
+}
+
+__attribute__((target("sse2")))
+static void copySpanSSE2(uint32_t *dest, const uint32_t *src, int count)
+{
+	int i = 0;
+
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_si128((__m128i *)(dest + i), _mm_loadu_si128((const __m128i *)(src + i)));
+	copySpanScalar(dest + i, src + i, count - i);
+}
+
+// AVX2 spans, eight pixels at a time - unpacking and packing work within each 128 bit
+// half, so pixels come back out in the order they went in
+__attribute__((target("avx2")))
+static void fillSpanAVX2(uint32_t *dest, int count, uint32_t pixel)
+{
+	__m256i pixels = _mm256_set1_epi32(pixel);
+	int i = 0;
+
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_si256((__m256i *)(dest + i), pixels);
+	fillSpanScalar(dest + i, count - i, pixel);
+}
+
+__attribute__((target("avx2")))
+static __m256i blendChannelsAVX2(__m256i dest, __m256i inverse, __m256i pixelTerm)
+{
+	__m256i sum = _mm256_add_epi16(_mm256_mullo_epi16(dest, inverse), pixelTerm);
+	return _mm256_srli_epi16(_mm256_add_epi16(sum, _mm256_srli_epi16(sum, 8)), 8);
+}
+
+__attribute__((target("avx2")))
+static void blendSpanAVX2(uint32_t *dest, int count, uint32_t pixel, uint32_t alpha)
+{
+	__m256i zero = _mm256_setzero_si256();
+	__m256i inverse = _mm256_set1_epi16(255 - alpha);
+	__m256i pixelTerm = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(
+		_mm256_set1_epi32(pixel & 0xFFFFFF), zero), _mm256_set1_epi16(alpha)),
+		_mm256_set1_epi16(128));
+	__m256i rgbMask = _mm256_set1_epi32(0xFFFFFF);
+	int i = 0;
+
+	for (; i + 8 <= count; i += 8) {
+		__m256i pixels = _mm256_loadu_si256((__m256i *)(dest + i));
+		__m256i low = blendChannelsAVX2(_mm256_unpacklo_epi8(pixels, zero), inverse, pixelTerm);
+		__m256i high = blendChannelsAVX2(_mm256_unpackhi_epi8(pixels, zero), inverse, pixelTerm);
+		_mm256_storeu_si256((__m256i *)(dest + i),
+			_mm256_and_si256(_mm256_packus_epi16(low, high), rgbMask));
+	}
+	blendSpanSSE2(dest + i, count - i, pixel, alpha);
+}
+
+__attribute__((target("avx2")))
+static void copySpanAVX2(uint32_t *dest, const uint32_t *src, int count)
+{
+	int i = 0;
+
+	for (; i + 8 <= count; i += 8)
+		_mm256_storeu_si256((__m256i *)(dest + i), _mm256_loadu_si256((const __m256i *)(src + i)));
+	copySpanSSE2(dest + i, src + i, count - i);
+}
+#endif
+
+// Spans for each path, with NULL entries for paths not compiled in
+static const RasterSpans spanTable[NumberOfRasterPaths] = {
+	[RasterScalar] = { fillSpanScalar, blendSpanScalar, copySpanScalar },
+#ifdef RASTER_X86
+	[RasterSSE2] = { fillSpanSSE2, blendSpanSSE2, copySpanSSE2 },
+	[RasterAVX2] = { fillSpanAVX2, blendSpanAVX2, copySpanAVX2 },
+#endif
+};
+
+static const char *pathNames[NumberOfRasterPaths] = { "scalar", "sse2", "avx2" };
+
+// The path in use, and its spans
+static RasterPath currentPath = RasterScalar;
+static const RasterSpans *spans = &spanTable[RasterScalar];
+
+// This says if a path is compiled in and the CPU can run it
+bool isRasterPathSupported(RasterPath path)
+{
+	switch (path) {
+	case RasterScalar:
+		return true;
+#ifdef RASTER_X86
+	case RasterSSE2:
+		return __builtin_cpu_supports("sse2");
+	case RasterAVX2:
+		return __builtin_cpu_supports("avx2");
+#endif
+	default:
+		return false;
+	}
+}
+
+// This picks the best path the CPU supports
+void initRaster(void)
+{
+#ifdef RASTER_X86
+	__builtin_cpu_init();
+#endif
+	for (int path = NumberOfRasterPaths - 1; path >= RasterScalar; --path) {
+		if (setRasterPath(path))
+			return;
+	}
+}
+
+RasterPath getRasterPath(void)
+{
+	return currentPath;
+}
+
+// This forces a path, for comparing them - returns false if it can't run here
+bool setRasterPath(RasterPath path)
+{
+	if (path < RasterScalar || path >= NumberOfRasterPaths || !isRasterPathSupported(path))
+		return false;
+
+	currentPath = path;
+	spans = &spanTable[path];
+	return true;
+}
+
+const char *getRasterPathName(RasterPath path)
+{
+	if (path < RasterScalar || path >= NumberOfRasterPaths)
+		return "unknown";
+	return pathNames[path];
+}
+
+// This clips a rectangle to the target, returning false if nothing is left
+static bool clipRect(const RasterTarget *target, int *x, int *y, int *width, int *height)
+{
+	int x1 = *x + *width, y1 = *y + *height;
+
+	if (*x < 0)
+		*x = 0;
+	if (*y < 0)
+		*y = 0;
+	if (x1 > target->width)
+		x1 = target->width;
+	if (y1 > target->height)
+		y1 = target->height;
+
+	*width = x1 - *x;
+	*height = y1 - *y;
+	return *width > 0 && *height > 0;
+}
+
+// This fills a rectangle with one colour
+void rasterFillRect(RasterTarget *target, int x, int y, int width, int height, uint32_t pixel)
+{
+	if (!clipRect(target, &x, &y, &width, &height))
+		return;
+
+	uint32_t *row = target->pixels + (long)y * target->stride + x;
+	for (int i = 0; i < height; ++i, row += target->stride)
+		spans->fillSpan(row, width, pixel);
+}
+
+// This blends one colour over a rectangle, with alpha from 0 (invisible) to 255 (opaque)
+void rasterBlendRect(RasterTarget *target, int x, int y, int width, int height, uint32_t pixel,
+	uint8_t alpha)
+{
+	if (alpha == 255) {
+		rasterFillRect(target, x, y, width, height, pixel);
+		return;
+	}
+	if (alpha == 0 || !clipRect(target, &x, &y, &width, &height))
+		return;
+
+	uint32_t *row = target->pixels + (long)y * target->stride + x;
+	for (int i = 0; i < height; ++i, row += target->stride)
+		spans->blendSpan(row, width, pixel, alpha);
+}
+
+// This copies the whole of source into target with its top left corner at x, y
+void rasterBlit(RasterTarget *target, int x, int y, const RasterTarget *source)
+{
+	int destX = x, destY = y, width = source->width, height = source->height;
+
+	if (!clipRect(target, &destX, &destY, &width, &height))
+		return;
+
+	uint32_t *row = target->pixels + (long)destY * target->stride + destX;
+	const uint32_t *srcRow = source->pixels + (long)(destY - y) * source->stride + (destX - x);
+	for (int i = 0; i < height; ++i, row += target->stride, srcRow += source->stride)
+		spans->copySpan(row, srcRow, width);
+}
@@ -0,0 +1,30 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for the software rasterizer */
+#ifndef RASTER
+#define RASTER
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Code paths the rasterizer can take, best last
+typedef enum { RasterScalar, RasterSSE2, RasterAVX2, NumberOfRasterPaths } RasterPath;
+
+// Raster target structure - 0xRRGGBB pixels, with stride counted in pixels
+typedef struct {
+	uint32_t *pixels;
+	int width;
+	int height;
+	int stride;
+} RasterTarget;
+
+void initRaster(void);
+RasterPath getRasterPath(void);
+bool setRasterPath(RasterPath path);
+bool isRasterPathSupported(RasterPath path);
+const char *getRasterPathName(RasterPath path);
+void rasterFillRect(RasterTarget *target, int x, int y, int width, int height, uint32_t pixel);
+void rasterBlendRect(RasterTarget *target, int x, int y, int width, int height, uint32_t pixel,
+	uint8_t alpha);
+void rasterBlit(RasterTarget *target, int x, int y, const RasterTarget *source);
+
+#endif
@@ -0,0 +1,164 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This times each of the rasterizer's code paths on each of its operations, and reports
+ * pixels per second. It also checks every path leaves the frame exactly as the scalar
+ * path does */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "raster.h"
+#include "phil_error.h"
+
+// Operations we time
+typedef enum { OpFill, OpBlend, OpBlit, NumberOfOps } RasterOp;
+
+static const char *opNames[NumberOfOps] = { "fill", "blend", "blit" };
+
+/* Print usage and exit */
+static void usage(const char *progName)
+{
+	fprintf(stderr, "Usage: %s [-s size] [-n frames]\n", progName);
+	fprintf(stderr, "  -s  draw into a frame this many pixels square (default 1000)\n"
+			"  -n  draw this many frames per operation (default 200)\n");
+	exit(EXIT_FAILURE);
+}
+
+/* Nanoseconds from the monotonic clock */
+static uint64_t nowNs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* Make a target of the given size, with rows padded so spans start unaligned */
+static void createTarget(RasterTarget *target, int size)
+{
+	target->width = size;
+	target->height = size;
+	target->stride = size + 3;
+	target->pixels = malloc((size_t)target->stride * size * sizeof(uint32_t));
+	if (!target->pixels)
+		philError("malloc");
+}
+
+/* Fill a target with a repeatable pattern */
+static void fillPattern(RasterTarget *target, uint32_t seed)
+{
+	for (int y = 0; y < target->height; ++y) {
+		for (int x = 0; x < target->width; ++x) {
+			seed = seed * 1664525 + 1013904223;
+			target->pixels[(long)y * target->stride + x] = seed >> 8;
+		}
+	}
+}
+
+/* Draw one frame of an operation - an odd offset keeps the clipping and the spans' tails
+ * busy too */
+static void drawFrame(RasterOp op, RasterTarget *target, RasterTarget *source, int frame)
+{
+	int offset = frame % 7 - 3;
+
+	switch (op) {
+	case OpFill:
+		rasterFillRect(target, offset, offset, target->width, target->height,
+			0xFF0000 + frame);
+		break;
+	case OpBlend:
+		rasterBlendRect(target, offset, offset, target->width, target->height,
+			0x0000FF + (frame << 8), 96);
+		break;
+	case OpBlit:
+		rasterBlit(target, offset, offset, source);
+		break;
+	default:
+		break;
+	}
+}
+
+/* Sum a target's pixels, to compare paths */
+static uint64_t checksumTarget(RasterTarget *target)
+{
+	uint64_t sum = 0;
+
+	for (int y = 0; y < target->height; ++y) {
+		for (int x = 0; x < target->width; ++x)
+			sum = sum * 31 + target->pixels[(long)y * target->stride + x];
+	}
+	return sum;
+}
+
+/* Entry point */
+int main(int argc, char **argv)
+{
+	// Variables
+	int opt, size = 1000, frames = 200;
+	RasterTarget target, source;
+	uint64_t expected[NumberOfOps];
+	bool mismatch = false;
+
+	// Parse options
+	while ((opt = getopt(argc, argv, "s:n:")) != -1) {
+		switch (opt) {
+		case 's':
+			size = atoi(optarg);
+			if (size <= 0)
+				usage(argv[0]);
+			break;
+		case 'n':
+			frames = atoi(optarg);
+			if (frames <= 0)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc)
+		usage(argv[0]);
+
+	createTarget(&target, size);
+	createTarget(&source, size);
+	fillPattern(&source, 1);
+
+	initRaster();
+	printf("%dx%d frames, %d per operation, runtime choice is %s\n", size, size, frames,
+		getRasterPathName(getRasterPath()));
+	printf("%-8s %-6s %14s\n", "path", "op", "Mpixels/s");
+
+	for (int path = RasterScalar; path < NumberOfRasterPaths; ++path) {
+		if (!setRasterPath(path)) {
+			printf("%-8s (not supported on this CPU)\n", getRasterPathName(path));
+			continue;
+		}
+
+		for (int op = OpFill; op < NumberOfOps; ++op) {
+			// Start from the same frame every time, so the results can be compared
+			fillPattern(&target, 2);
+			uint64_t start = nowNs();
+			for (int frame = 0; frame < frames; ++frame)
+				drawFrame(op, &target, &source, frame);
+			uint64_t elapsedNs = nowNs() - start;
+
+			uint64_t checksum = checksumTarget(&target);
+			if (path == RasterScalar) {
+				expected[op] = checksum;
+			} else if (checksum != expected[op]) {
+				mismatch = true;
+				printf("%-8s %-6s differs from scalar\n", getRasterPathName(path),
+					opNames[op]);
+			}
+
+			double pixels = (double)size * size * frames;
+			printf("%-8s %-6s %14.1f\n", getRasterPathName(path), opNames[op],
+				pixels / (elapsedNs / 1e9) / 1e6);
+		}
+	}
+
+	free(target.pixels);
+	free(source.pixels);
+	return mismatch ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This draws the window on a thread of its own, over a connection of its own, so however
+ * long a frame takes, the event loop is free to answer XdndPosition with XdndStatus. The
+ * event loop publishes each scene into a triple buffer and wakes the thread through a
+ * pipe - publishing never blocks or takes a lock, and the thread always draws the newest
+ * scene, skipping any it was too busy to get to.
+ *
+ * Each thread only ever uses its own Display, so Xlib needs no locking (no XInitThreads).
+ * The renderer is set up before the thread starts, as attaching shared memory swaps the
+ * process-wide error handler for a moment. A heavy scene is simulated by drawing each
+ * frame several times over before presenting it */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <X11/Xlib.h>
+#include "render_thread.h"
+#include "renderer.h"
+#include "phil_error.h"
+
+// The middle slot index, and the bit saying it holds a scene not yet drawn
+#define SCENE_SLOT_MASK 3
+#define SCENE_FRESH 4
+
+// This draws a scene into the client-side frame if there is one, or with core requests
+// if not, drawing it passes times over to make it as heavy as asked for
+void drawScene(Display *disp, Window wind, GC gContext, Renderer *renderer,
+	const SceneState *scene, int passes)
+{
+	if (renderer) {
+		for (int i = 0; i < passes; ++i) {
+			clearRenderer(renderer, scene->background);
+			if (!scene->visible)
+				continue;
+
+			// Draw just the outline while the dropped state is still loading
+			if (scene->pending) {
+				outlineRendererRect(renderer, scene->x, scene->y, scene->size, scene->size,
+					scene->foreground);
+			} else {
+				fillRendererRect(renderer, scene->x, scene->y, scene->size, scene->size,
+					scene->foreground);
+			}
+		}
+		presentRenderer(renderer);
+		return;
+	}
+
+	XSetForeground(disp, gContext, scene->foreground);
+	for (int i = 0; i < passes; ++i) {
+		XClearWindow(disp, wind);
+		if (!scene->visible)
+			continue;
+
+		// Draw just the outline while the dropped state is still loading
+		if (scene->pending) {
+			XDrawRectangle(disp, wind, gContext, scene->x, scene->y, scene->size - 1,
+				scene->size - 1);
+		} else {
+			XFillRectangle(disp, wind, gContext, scene->x, scene->y, scene->size,
+				scene->size);
+		}
+	}
+	XFlush(disp);
+}
+
+// This swaps the newest scene into the slot the thread draws from, returning false if
+// there is nothing new
+static bool takeScene(RenderThread *renderThread)
+{
+	if (!(atomic_load_explicit(&renderThread->middle, memory_order_acquire) & SCENE_FRESH))
+		return false;
+
+	unsigned int old = atomic_exchange_explicit(&renderThread->middle, renderThread->reading,
+		memory_order_acq_rel);
+	renderThread->reading = old & SCENE_SLOT_MASK;
+	return true;
+}
+
+// This is the thread body - it sleeps on the pipe until there is a scene to draw
+static void *renderThreadBody(void *arg)
+{
+	RenderThread *renderThread = arg;
+	char wakeups[64];
+
+	while (atomic_load(&renderThread->running)) {
+		if (read(renderThread->pipeFds[0], wakeups, sizeof(wakeups)) < 0 && errno != EINTR)
+			philError("read");
+		while (takeScene(renderThread)) {
+			drawScene(renderThread->disp, renderThread->wind, renderThread->gContext,
+				renderThread->rendering ? &renderThread->renderer : NULL,
+				&renderThread->slots[renderThread->reading], renderThread->passes);
+			renderThread->frames++;
+		}
+	}
+
+	return NULL;
+}
+
+// This opens a second connection to the display and starts drawing the window on a thread
+// of its own, returning false if the connection can't be made
+bool startRenderThread(RenderThread *renderThread, Display *disp, Window wind, int width,
+	int height, bool coreDrawing, int passes, const char *procStr)
+{
+	memset(renderThread, 0, sizeof(*renderThread));
+	renderThread->disp = XOpenDisplay(DisplayString(disp));
+	if (!renderThread->disp)
+		return false;
+	renderThread->wind = wind;
+	renderThread->passes = passes;
+	renderThread->procStr = procStr;
+	renderThread->gContext = XCreateGC(renderThread->disp, wind, 0, NULL);
+	if (renderThread->gContext == 0)
+		philError("XCreateGC");
+
+	// Draw into a client-side image if we can, falling back to core requests if not
+	if (!coreDrawing) {
+		renderThread->rendering = initRenderer(&renderThread->renderer, renderThread->disp,
+			wind, renderThread->gContext, width, height, procStr);
+		if (!renderThread->rendering)
+			printf("%s: no client-side image for this visual, drawing with core requests\n",
+				procStr);
+	}
+
+	// Only the read end blocks - publishing a scene never waits
+	if (pipe(renderThread->pipeFds) < 0)
+		philError("pipe");
+	if (fcntl(renderThread->pipeFds[1], F_SETFL, O_NONBLOCK) < 0)
+		philError("fcntl");
+
+	renderThread->writing = 0;
+	atomic_init(&renderThread->middle, 1);
+	renderThread->reading = 2;
+	atomic_init(&renderThread->running, true);
+	if (pthread_create(&renderThread->thread, NULL, renderThreadBody, renderThread) != 0)
+		philError("pthread_create");
+
+	printf("%s: drawing on a render thread with its own connection\n", procStr);
+	return true;
+}
+
+// This hands a scene to the render thread. Only the first scene since the thread last
+// looked wakes it - it takes the newest one whenever it gets there
+void publishScene(RenderThread *renderThread, const SceneState *scene)
+{
+	renderThread->slots[renderThread->writing] = *scene;
+	unsigned int old = atomic_exchange_explicit(&renderThread->middle,
+		renderThread->writing | SCENE_FRESH, memory_order_acq_rel);
+	renderThread->writing = old & SCENE_SLOT_MASK;
+	renderThread->published++;
+
+	// A full pipe already has a wakeup in it, so there is nothing to do if this fails
+	if (!(old & SCENE_FRESH)) {
+		char wakeup = 0;
+		if (write(renderThread->pipeFds[1], &wakeup, 1) < 0 && errno != EAGAIN)
+			philError("write");
+	}
+}
+
+// This stops the thread once it has drawn what it has, reporting how many scenes it
+// skipped, and closes its connection
+void stopRenderThread(RenderThread *renderThread)
+{
+	char wakeup = 0;
+
+	atomic_store(&renderThread->running, false);
+	if (write(renderThread->pipeFds[1], &wakeup, 1) < 0 && errno != EAGAIN)
+		philError("write");
+	if (pthread_join(renderThread->thread, NULL) != 0)
+		philError("pthread_join");
+
+	printf("%s: render thread drew %lu of %lu scenes\n", renderThread->procStr,
+		renderThread->frames, renderThread->published);
+	close(renderThread->pipeFds[0]);
+	close(renderThread->pipeFds[1]);
+	if (renderThread->rendering)
+		destroyRenderer(&renderThread->renderer);
+	XFreeGC(renderThread->disp, renderThread->gContext);
+	XCloseDisplay(renderThread->disp);
+}
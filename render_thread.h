@@ -0,0 +1,53 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for the render thread */
+#ifndef RENDER_THREAD
+#define RENDER_THREAD
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <X11/Xlib.h>
+#include "renderer.h"
+
+// Everything a frame is drawn from, copied out of the event loop's state
+typedef struct {
+	int x;
+	int y;
+	int size;
+	bool visible;
+	bool pending;
+	uint32_t foreground;
+	uint32_t background;
+} SceneState;
+
+// Render thread structure - scenes pass from the event loop through a triple buffer, so
+// neither side ever waits for the other. The event loop owns the slot being written, the
+// render thread the slot being drawn, and the middle one is swapped between them
+typedef struct {
+	pthread_t thread;
+	Display *disp;
+	Window wind;
+	GC gContext;
+	Renderer renderer;
+	bool rendering;
+	int passes;
+	int pipeFds[2];
+	SceneState slots[3];
+	_Atomic unsigned int middle;
+	unsigned int writing;
+	unsigned int reading;
+	atomic_bool running;
+	unsigned long published;
+	unsigned long frames;
+	const char *procStr;
+} RenderThread;
+
+void drawScene(Display *disp, Window wind, GC gContext, Renderer *renderer,
+	const SceneState *scene, int passes);
+bool startRenderThread(RenderThread *renderThread, Display *disp, Window wind, int width,
+	int height, bool coreDrawing, int passes, const char *procStr);
+void publishScene(RenderThread *renderThread, const SceneState *scene);
+void stopRenderThread(RenderThread *renderThread);
+
+#endif
@@ -0,0 +1,204 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This draws the scene into a client-side image and presents it with a single request,
+ * rather than sending each shape through the X socket. The image lives in a MIT-SHM
+ * segment when the server supports it and can see our memory, and is pushed with
+ * XPutImage otherwise.
+ *
+ * Only 32 bits per pixel TrueColor visuals are handled, as the rest of the program already
+ * assumes 0xRRGGBB pixel values - initRenderer() returns false for anything else, and the
+ * caller draws with core requests instead. Frames are not double buffered, so the server
+ * may still be reading one XShm frame as we draw the next - at worst that tears */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XShm.h>
+#include "renderer.h"
+#include "raster.h"
+#include "phil_error.h"
+
+// Set by our temporary error handler if attaching the segment fails
+static bool shmAttachFailed;
+
+static int shmErrorHandler(Display *disp, XErrorEvent *error)
+{
+	shmAttachFailed = true;
+	return 0;
+}
+
+// This tries to create a shared memory image, returning false if we can't
+static bool createShmImage(Renderer *renderer, Visual *visual, int depth)
+{
+	if (!XShmQueryExtension(renderer->disp))
+		return false;
+
+	renderer->image = XShmCreateImage(renderer->disp, visual, depth, ZPixmap, NULL,
+		&renderer->shmInfo, renderer->width, renderer->height);
+	if (!renderer->image)
+		return false;
+
+	renderer->shmInfo.shmid = shmget(IPC_PRIVATE,
+		renderer->image->bytes_per_line * renderer->image->height, IPC_CREAT | 0600);
+	if (renderer->shmInfo.shmid < 0) {
+		XDestroyImage(renderer->image);
+		renderer->image = NULL;
+		return false;
+	}
+	renderer->shmInfo.shmaddr = renderer->image->data = shmat(renderer->shmInfo.shmid, NULL, 0);
+	renderer->shmInfo.readOnly = False;
+
+	// The server may not be able to see our memory (a remote display, say), which only
+	// shows up as an error, so wait for it here - this is the one round trip we take
+	shmAttachFailed = false;
+	int (*oldHandler)(Display *, XErrorEvent *) = XSetErrorHandler(shmErrorHandler);
+	if (renderer->shmInfo.shmaddr != (char *)-1)
+		XShmAttach(renderer->disp, &renderer->shmInfo);
+	else
+		shmAttachFailed = true;
+	XSync(renderer->disp, False);
+	XSetErrorHandler(oldHandler);
+
+	// Mark the segment for removal now, so it goes away with us however we exit
+	shmctl(renderer->shmInfo.shmid, IPC_RMID, NULL);
+
+	if (shmAttachFailed) {
+		if (renderer->shmInfo.shmaddr != (char *)-1)
+			shmdt(renderer->shmInfo.shmaddr);
+		renderer->image->data = NULL;
+		XDestroyImage(renderer->image);
+		renderer->image = NULL;
+		return false;
+	}
+
+	return true;
+}
+
+// This creates a plain image in our own memory, to be sent with XPutImage
+static bool createPlainImage(Renderer *renderer, Visual *visual, int depth)
+{
+	renderer->image = XCreateImage(renderer->disp, visual, depth, ZPixmap, 0, NULL,
+		renderer->width, renderer->height, 32, 0);
+	if (!renderer->image)
+		return false;
+
+	renderer->image->data = malloc(renderer->image->bytes_per_line * renderer->image->height);
+	if (!renderer->image->data)
+		philError("malloc");
+
+	return true;
+}
+
+// This sets up the image, preferring shared memory
+bool initRenderer(Renderer *renderer, Display *disp, Window wind, GC gContext,
+	int width, int height, const char *procStr)
+{
+	int screen = DefaultScreen(disp);
+	Visual *visual = DefaultVisual(disp, screen);
+	int depth = DefaultDepth(disp, screen);
+
+	memset(renderer, 0, sizeof(*renderer));
+	renderer->disp = disp;
+	renderer->wind = wind;
+	renderer->gContext = gContext;
+	renderer->width = width;
+	renderer->height = height;
+	renderer->procStr = procStr;
+
+	if (visual->class != TrueColor || (depth != 24 && depth != 32))
+		return false;
+
+	renderer->useShm = createShmImage(renderer, visual, depth);
+	if (!renderer->useShm && !createPlainImage(renderer, visual, depth))
+		return false;
+
+	// Make sure we really have four bytes per pixel
+	if (renderer->image->bits_per_pixel != 32) {
+		destroyRenderer(renderer);
+		return false;
+	}
+
+	// Let the rasterizer draw straight into the image
+	renderer->target.pixels = (uint32_t *)renderer->image->data;
+	renderer->target.width = width;
+	renderer->target.height = height;
+	renderer->target.stride = renderer->image->bytes_per_line / 4;
+	initRaster();
+
+	clock_gettime(CLOCK_MONOTONIC, &renderer->fpsStart);
+	printf("%s: rendering %dx%d frames with %s and the %s rasterizer\n", procStr, width,
+		height, renderer->useShm ? "XShmPutImage" : "XPutImage",
+		getRasterPathName(getRasterPath()));
+
+	return true;
+}
+
+// This fills the whole frame with one colour
+void clearRenderer(Renderer *renderer, uint32_t pixel)
+{
+	fillRendererRect(renderer, 0, 0, renderer->width, renderer->height, pixel);
+}
+
+// This fills a rectangle, clipped to the frame
+void fillRendererRect(Renderer *renderer, int x, int y, int width, int height, uint32_t pixel)
+{
+	rasterFillRect(&renderer->target, x, y, width, height, pixel);
+}
+
+// This draws a one pixel wide rectangle outline, clipped to the frame
+void outlineRendererRect(Renderer *renderer, int x, int y, int width, int height, uint32_t pixel)
+{
+	fillRendererRect(renderer, x, y, width, 1, pixel);
+	fillRendererRect(renderer, x, y + height - 1, width, 1, pixel);
+	fillRendererRect(renderer, x, y, 1, height, pixel);
+	fillRendererRect(renderer, x + width - 1, y, 1, height, pixel);
+}
+
+// This sends the frame to the window, and reports the frame rate once a second while
+// frames keep coming
+void presentRenderer(Renderer *renderer)
+{
+	if (renderer->useShm) {
+		XShmPutImage(renderer->disp, renderer->wind, renderer->gContext, renderer->image,
+			0, 0, 0, 0, renderer->width, renderer->height, False);
+	} else {
+		XPutImage(renderer->disp, renderer->wind, renderer->gContext, renderer->image,
+			0, 0, 0, 0, renderer->width, renderer->height);
+	}
+	XFlush(renderer->disp);
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	double elapsed = (now.tv_sec - renderer->fpsStart.tv_sec) +
+		(now.tv_nsec - renderer->fpsStart.tv_nsec) / 1e9;
+	renderer->frames++;
+	if (elapsed >= 1.0) {
+		if (renderer->frames > 1) {
+			printf("%s: %.1f frames per second (%dx%d, %s)\n", renderer->procStr,
+				renderer->frames / elapsed, renderer->width, renderer->height,
+				renderer->useShm ? "XShmPutImage" : "XPutImage");
+		}
+		renderer->frames = 0;
+		renderer->fpsStart = now;
+	}
+}
+
+// This frees the image and detaches any shared memory
+void destroyRenderer(Renderer *renderer)
+{
+	if (!renderer->image)
+		return;
+
+	if (renderer->useShm) {
+		XShmDetach(renderer->disp, &renderer->shmInfo);
+		shmdt(renderer->shmInfo.shmaddr);
+		renderer->image->data = NULL;
+	}
+	XDestroyImage(renderer->image);
+	renderer->image = NULL;
+}
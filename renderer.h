@@ -0,0 +1,37 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for the client-side image renderer */
+#ifndef RENDERER
+#define RENDERER
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <X11/Xlib.h>
+#include <X11/extensions/XShm.h>
+#include "raster.h"
+
+// Renderer structure - frames are drawn into image, then presented in one request
+typedef struct {
+	Display *disp;
+	Window wind;
+	GC gContext;
+	XImage *image;
+	XShmSegmentInfo shmInfo;
+	RasterTarget target;
+	bool useShm;
+	int width;
+	int height;
+	struct timespec fpsStart;
+	unsigned long frames;
+	const char *procStr;
+} Renderer;
+
+bool initRenderer(Renderer *renderer, Display *disp, Window wind, GC gContext,
+	int width, int height, const char *procStr);
+void clearRenderer(Renderer *renderer, uint32_t pixel);
+void fillRendererRect(Renderer *renderer, int x, int y, int width, int height, uint32_t pixel);
+void outlineRendererRect(Renderer *renderer, int x, int y, int width, int height, uint32_t pixel);
+void presentRenderer(Renderer *renderer);
+void destroyRenderer(Renderer *renderer);
+
+#endif
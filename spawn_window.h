@@ -6,6 +6,22 @@
 #include <sys/types.h>
 #include <stdbool.h>
 
-void spawnWindow(pid_t procId);
+// Options chosen on the command line
+typedef struct {
+	bool finishAfterLoad;
+	int timeoutMs;
+	const char *tracePath;
+	int windowSize;
+	bool coreDrawing;
+	bool lazyPayload;
+	int previewMegabytes;
+	int midiMegabytes;
+	int cacheMegabytes;
+	int scenePasses;
+	bool inlineRendering;
+	bool prefetchDrops;
+} SpawnOptions;
+
+void spawnWindow(pid_t procId, const SpawnOptions *options);
 
 #endif
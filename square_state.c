@@ -1,44 +1,172 @@
 /* Copyright Phillip Potter, 2020 - MIT License
- * This contains the routine to save and load state for the square from a temporary file */
+ * This contains the routine to save and load state for the square from a temporary file.
+ * The state can be followed by preview data, standing in for the waveforms and piano rolls
+ * real objects carry, so large payloads can be dragged about - only the colour is read
+ * back. A payload can also be read whole into memory, for a target to keep, and hashed
+ * without being written, so a target can tell whether it already holds it - the hash is of
+ * the very bytes that would be written, as both go through the same code.
+ *
+ * Reading is done on files another program hands us, which may have gone or be cut short
+ * by the time we get to them, so failures there are returned with errno set rather than
+ * ending the process */
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include "square_state.h"
 #include "phil_error.h"
 
-#define SQUARE_FILE_PATH "/tmp/square.state"
+#define PREVIEW_CHUNK_SIZE (1024 * 1024)
 
-// This function saves the square state to a temporary file and returns its pathname 
-const char *saveSquareState(Square *square)
+// This gives the byte the preview data is filled with
+static int getPreviewFill(Square *square)
+{
+	return square->colour == RedSquare ? 0xF0 : 0x0F;
+}
+
+// Where the bytes of a payload go as they are produced
+typedef void (*PayloadSink)(void *sinkData, const void *bytes, size_t size);
+
+// This produces the bytes of a payload - the square state, then that many bytes of preview
+// data - handing them to sink a piece at a time
+static void producePayload(Square *square, size_t previewBytes, PayloadSink sink, void *sinkData)
+{
+	// State
+	sink(sinkData, &square->colour, sizeof(SquareColour));
+
+	// Preview data, a chunk at a time
+	if (previewBytes > 0) {
+		char *chunk = malloc(PREVIEW_CHUNK_SIZE);
+		if (!chunk)
+			philError("malloc");
+		memset(chunk, getPreviewFill(square), PREVIEW_CHUNK_SIZE);
+		while (previewBytes > 0) {
+			size_t chunkSize = previewBytes < PREVIEW_CHUNK_SIZE ? previewBytes : PREVIEW_CHUNK_SIZE;
+			sink(sinkData, chunk, chunkSize);
+			previewBytes -= chunkSize;
+		}
+		free(chunk);
+	}
+}
+
+// This writes payload bytes to a file
+static void writeToFile(void *sinkData, const void *bytes, size_t size)
+{
+	if (fwrite(bytes, 1, size, sinkData) != size)
+		philError("fwrite");
+}
+
+// This folds payload bytes into a 64 bit FNV-1a hash
+static void addToHash(void *sinkData, const void *bytes, size_t size)
+{
+	uint64_t *hash = sinkData;
+	const unsigned char *next = bytes;
+
+	for (size_t i = 0; i < size; ++i) {
+		*hash ^= next[i];
+		*hash *= 0x100000001B3ULL;
+	}
+}
+
+// This function saves the square state, and that many bytes of preview data, to the
+// supplied path
+void saveSquareState(Square *square, const char *pathStr, size_t previewBytes)
 {
 	// Create/truncate the file
-	FILE *squareFile = fopen(SQUARE_FILE_PATH, "wb");
+	FILE *squareFile = fopen(pathStr, "wb");
 	if (!squareFile)
 		philError("fopen");
 
-	// Store state
-	if (fwrite(&square->colour, sizeof(SquareColour), 1, squareFile) != 1)
-		philError("fwrite");
+	// Store state and preview data
+	producePayload(square, previewBytes, writeToFile, squareFile);
 
 	// Close file
 	if (fclose(squareFile) != 0)
 		philError("fclose");
-
-	return SQUARE_FILE_PATH;
 }
 
-// This function restores the square state from the supplied path
-void restoreSquareState(const char *pathStr, Square *square)
+// This function restores the square state from the supplied path, returning false if it
+// can't be read
+bool restoreSquareState(const char *pathStr, Square *square)
 {
 	// Open the file
 	FILE *squareFile = fopen(pathStr, "rb");
 	if (!squareFile)
-		philError("fopen");
+		return false;
 
-	// Restore state
-	if (fread(&square->colour, sizeof(SquareColour), 1, squareFile) != 1)
-		philError("fread");
+	// Restore state - a file cut short is no state at all
+	SquareColour colour;
+	if (fread(&colour, sizeof(SquareColour), 1, squareFile) != 1) {
+		int readError = ferror(squareFile) ? errno : EINVAL;
+		fclose(squareFile);
+		errno = readError;
+		return false;
+	}
+	fclose(squareFile);
+	square->colour = colour;
 
-	// Close file
-	if (fclose(squareFile) != 0)
-		philError("fclose");
+	return true;
+}
+
+// This reads a whole payload into memory, restoring the square state from it - the caller
+// must free the returned buffer. Returns NULL if it can't be read
+unsigned char *readSquareState(const char *pathStr, Square *square, size_t *sizeReturn)
+{
+	// Open the file and find its size
+	FILE *squareFile = fopen(pathStr, "rb");
+	if (!squareFile)
+		return NULL;
+	struct stat fileStat;
+	if (fstat(fileno(squareFile), &fileStat) != 0) {
+		int statError = errno;
+		fclose(squareFile);
+		errno = statError;
+		return NULL;
+	}
+
+	// Read all of it - if it shrank meanwhile, that is as bad as a read error
+	size_t size = fileStat.st_size;
+	unsigned char *bytes = malloc(size > 0 ? size : 1);
+	if (!bytes)
+		philError("malloc");
+	if (fread(bytes, 1, size, squareFile) != size) {
+		int readError = ferror(squareFile) ? errno : EINVAL;
+		free(bytes);
+		fclose(squareFile);
+		errno = readError;
+		return NULL;
+	}
+	fclose(squareFile);
+
+	if (!decodeSquareState(bytes, size, square)) {
+		free(bytes);
+		return NULL;
+	}
+	*sizeReturn = size;
+	return bytes;
+}
+
+// This restores the square state from a payload held in memory, returning false if it is
+// too short to hold any
+bool decodeSquareState(const unsigned char *bytes, size_t size, Square *square)
+{
+	if (size < sizeof(SquareColour)) {
+		errno = EINVAL;
+		return false;
+	}
+	memcpy(&square->colour, bytes, sizeof(SquareColour));
+	return true;
+}
+
+// This hashes the payload saveSquareState() would write, with 64 bit FNV-1a, without
+// writing it - every byte of it, so it takes as long as the payload is big
+uint64_t getSquareStateHash(Square *square, size_t previewBytes)
+{
+	uint64_t hash = 0xCBF29CE484222325ULL;
+
+	producePayload(square, previewBytes, addToHash, &hash);
+	return hash;
 }
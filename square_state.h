@@ -3,21 +3,26 @@
 #ifndef SQUARE_STATE
 #define SQUARE_STATE
 
-typedef enum { RedSquare = 0, BlueSquare = 1 } SquareColour;
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum { RedSquare = 0, BlueSquare = 1, NumberOfSquareColours } SquareColour;
 
 // Square structure
 typedef struct {
 	int x;
 	int y;
-	int mouse_x;
-	int mouse_y;
 	int size;
 	bool visible;
-	bool selected;
+	bool pending;
 	SquareColour colour;
 } Square;
 
-const char *saveSquareState(Square *square);
-void restoreSquareState(const char *pathStr, Square *square);
+void saveSquareState(Square *square, const char *pathStr, size_t previewBytes);
+bool restoreSquareState(const char *pathStr, Square *square);
+unsigned char *readSquareState(const char *pathStr, Square *square, size_t *sizeReturn);
+bool decodeSquareState(const unsigned char *bytes, size_t size, Square *square);
+uint64_t getSquareStateHash(Square *square, size_t previewBytes);
 
 #endif
@@ -0,0 +1,98 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This times what a target does to take a dropped payload for each drag action - copying
+ * it, moving it or linking to it - and then loading the square from it. The source's
+ * write is not timed, as that happens while the drag is still in progress. Payloads are
+ * fresh from the page cache, so this is the best case for a copy */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include "drop_transfer.h"
+#include "square_state.h"
+#include "phil_error.h"
+
+/* Print usage and exit */
+static void usage(const char *progName)
+{
+	fprintf(stderr, "Usage: %s [-m megabytes] [-n rounds]\n", progName);
+	fprintf(stderr, "  -m  preview data in each payload, in megabytes (default 100)\n"
+			"  -n  take this many payloads per action (default 5)\n");
+	exit(EXIT_FAILURE);
+}
+
+/* Nanoseconds from the monotonic clock */
+static uint64_t nowNs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* Entry point */
+int main(int argc, char **argv)
+{
+	// Variables
+	int opt, megabytes = 100, rounds = 5;
+	char sourcePath[64], keptPath[64];
+	Square square = { .colour = BlueSquare };
+	const DragAction actions[] = { DragCopy, DragMove, DragLink };
+
+	// Parse options
+	while ((opt = getopt(argc, argv, "m:n:")) != -1) {
+		switch (opt) {
+		case 'm':
+			megabytes = atoi(optarg);
+			if (megabytes < 0)
+				usage(argv[0]);
+			break;
+		case 'n':
+			rounds = atoi(optarg);
+			if (rounds <= 0)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc)
+		usage(argv[0]);
+
+	// Both files live in /tmp, as the windows' do, so a move is a rename - and the source is
+	// named like a payload the windows write, as only those are moved rather than copied
+	snprintf(sourcePath, sizeof(sourcePath), "/tmp/square.%d.0.state", (int)getpid());
+	snprintf(keptPath, sizeof(keptPath), "/tmp/transfer_bench.%d.kept", (int)getpid());
+
+	printf("%d MB payloads, %d per action\n", megabytes, rounds);
+	printf("%-8s %12s %12s %12s\n", "action", "mean ms", "max ms", "MB/s");
+	for (int i = 0; i < sizeof(actions) / sizeof(actions[0]); ++i) {
+		uint64_t totalNs = 0, maxNs = 0;
+
+		for (int round = 0; round < rounds; ++round) {
+			size_t bytes;
+			Square loaded;
+
+			saveSquareState(&square, sourcePath, (size_t)megabytes * 1024 * 1024);
+			uint64_t start = nowNs();
+			const char *loadPath = transferDroppedPayload(sourcePath, keptPath, actions[i], &bytes);
+			if (!loadPath || !restoreSquareState(loadPath, &loaded))
+				philError("transfer_bench");
+			uint64_t elapsedNs = nowNs() - start;
+
+			if (loaded.colour != square.colour)
+				philError("transfer_bench: %s payload came back wrong",
+					getDragActionName(actions[i]));
+			totalNs += elapsedNs;
+			if (elapsedNs > maxNs)
+				maxNs = elapsedNs;
+			unlink(sourcePath);
+			unlink(keptPath);
+		}
+
+		double meanMs = totalNs / 1e6 / rounds;
+		printf("%-8s %12.3f %12.3f %12.1f\n", getDragActionName(actions[i]), meanMs,
+			maxNs / 1e6, megabytes / (meanMs / 1e3));
+	}
+
+	return EXIT_SUCCESS;
+}
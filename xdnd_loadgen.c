@@ -0,0 +1,661 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This is a headless XDND source for finding out how much a target can take. It opens an
+ * invisible window for each synthetic drag and runs them all at once against one or more
+ * target windows - each enters, sends XdndPosition at a steady rate, drops, hands over a
+ * payload of the chosen size when the target converts the selection, and starts again once
+ * XdndFinished comes back. Messages go out through the same senders the windows use.
+ *
+ * Drags join one at a time over the first half of the run, so the load on each target
+ * climbs steadily, and are spread across the targets in turn. Like a real source, a drag
+ * never sends the next message until the last one has been answered - a drag still
+ * waiting when its next message is due is counted as waiting, and the first second in
+ * which more than a tenth of a target's drags were waiting is where its replies started
+ * queueing. A drag that waits longer than the timeout is abandoned and started again.
+ *
+ * Run it under Xvfb against xlib_xdnd_test's windows, or any other XDND target. All the
+ * windows share XdndSelection, which one more invisible window owns.
+ *
+ * Built with HAVE_XINPUT2, -x adds master pointers of our own with XIChangeHierarchy and
+ * shares the drags out between them - each XdndPosition warps its drag's pointer to the
+ * same spot, so the targets see several pointers moving over them at once while the
+ * exchanges run, as they would with MPX. The pointers are removed again at the end */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <errno.h>
+#include <time.h>
+#include <X11/Xlib.h>
+#ifdef HAVE_XINPUT2
+#include <X11/extensions/XInput2.h>
+#endif
+#include "event_handler.h"
+#include "xdnd_session.h"
+#include "square_state.h"
+#include "xerror_tracker.h"
+#include "phil_error.h"
+
+#define MAX_TARGETS 16
+#define MAX_POINTERS 16
+
+// One target window, and how it has coped
+typedef struct {
+	Window wind;
+	int rootX;
+	int rootY;
+	int width;
+	int height;
+	bool gone;
+	int activeDrags;
+	XdndSession *dropping;
+	unsigned long drops;
+	unsigned long statusReplies;
+	unsigned long rejected;
+	unsigned long failedDrops;
+	unsigned long timeouts;
+	unsigned long ticks;
+	unsigned long waitingTicks;
+	double latencyTotalMs;
+	double latencyMaxMs;
+	unsigned long secondDrops;
+	unsigned long secondReplies;
+	unsigned long secondTicks;
+	unsigned long secondWaitingTicks;
+	double secondLatencyTotalMs;
+	int queueingAt;
+	double queueingAfterS;
+} LoadTarget;
+
+// One synthetic drag, from an invisible window of its own - the session comes first so it
+// keeps its cache line
+typedef struct {
+	XdndSession xdnd;
+	Window wind;
+	LoadTarget *target;
+	bool started;
+	bool awaitingReply;
+	int positionsSent;
+	uint64_t startNs;
+	uint64_t nextTickNs;
+	uint64_t waitingSinceNs;
+} LoadDrag;
+
+// Everything the run needs
+typedef struct {
+	Display *disp;
+	Window owner;
+	LoadTarget targets[MAX_TARGETS];
+	int numberOfTargets;
+	LoadDrag *drags;
+	int numberOfDrags;
+	LoadDrag **byWindow;
+	size_t byWindowMask;
+	int pointers[MAX_POINTERS];
+	int numberOfPointers;
+	uint64_t periodNs;
+	uint64_t timeoutNs;
+	int positionsPerDrag;
+	char pathStr[64];
+	Atom uriList;
+	Atom actionCopy;
+	Atom status;
+	Atom finished;
+	Atom selection;
+} LoadRun;
+
+/* Print usage and exit */
+static void usage(const char *progName)
+{
+	fprintf(stderr, "Usage: %s [-w window]... [-n drags] [-r rate] [-k positions] [-p kilobytes]\n"
+		"       [-t seconds] [-o milliseconds] [-x pointers]\n", progName);
+	fprintf(stderr, "  -w  target window to drag onto - may be given up to %d times (default\n"
+			"      every top-level XdndAware window)\n"
+			"  -n  drags to run at once, at full load (default 100)\n"
+			"  -r  XdndPosition messages per second from each drag (default 50)\n"
+			"  -k  XdndPosition messages before each drop (default 10)\n"
+			"  -p  pad the dropped payload with this many kilobytes (default 0)\n"
+			"  -t  run for this many seconds (default 10)\n"
+			"  -o  abandon a drag after waiting this many milliseconds for a\n"
+			"      reply (default 1000)\n"
+			"  -x  move this many master pointers of our own along with the drags,\n"
+			"      up to %d (needs XInput2, default none)\n", MAX_TARGETS, MAX_POINTERS);
+	exit(EXIT_FAILURE);
+}
+
+/* Nanoseconds from the monotonic clock */
+static uint64_t nowNs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+#ifdef HAVE_XINPUT2
+/* This adds master pointers for the drags to move, named after us so they can be found */
+static void addPointers(LoadRun *run, int count)
+{
+	int event, error, opcode, major = 2, minor = 0;
+	char names[MAX_POINTERS][64];
+
+	if (!XQueryExtension(run->disp, "XInputExtension", &opcode, &event, &error) ||
+		XIQueryVersion(run->disp, &major, &minor) != Success || major < 2)
+		philError("xdnd_loadgen: no XInput 2.0 for -x");
+	for (int i = 0; i < count; ++i) {
+		XIAnyHierarchyChangeInfo change;
+		snprintf(names[i], sizeof(names[i]), "xdnd_loadgen.%d.%d", (int)getpid(), i);
+		change.add.type = XIAddMaster;
+		change.add.name = names[i];
+		change.add.send_core = True;
+		change.add.enable = True;
+		if (XIChangeHierarchy(run->disp, &change, 1) != Success)
+			philError("XIChangeHierarchy");
+	}
+	XSync(run->disp, False);
+
+	// The server calls each new master pointer by our name plus " pointer"
+	int numberOfDevices;
+	XIDeviceInfo *devices = XIQueryDevice(run->disp, XIAllMasterDevices, &numberOfDevices);
+	for (int i = 0; i < count; ++i) {
+		char pointerName[80];
+		snprintf(pointerName, sizeof(pointerName), "%s pointer", names[i]);
+		for (int j = 0; j < numberOfDevices; ++j) {
+			if (devices[j].use == XIMasterPointer && strcmp(devices[j].name, pointerName) == 0)
+				run->pointers[run->numberOfPointers++] = devices[j].deviceid;
+		}
+	}
+	XIFreeDeviceInfo(devices);
+	if (run->numberOfPointers != count)
+		philError("xdnd_loadgen: only found %d of %d new pointers", run->numberOfPointers, count);
+}
+
+/* This puts a drag's pointer where its XdndPosition says it is */
+static void movePointer(LoadRun *run, LoadDrag *drag, int x, int y)
+{
+	if (run->numberOfPointers == 0)
+		return;
+	int pointer = run->pointers[(drag - run->drags) % run->numberOfPointers];
+	XIWarpPointer(run->disp, pointer, None, DefaultRootWindow(run->disp), 0, 0, 0, 0, x, y);
+}
+
+/* This removes the master pointers we added, leaving anything attached to them floating */
+static void removePointers(LoadRun *run)
+{
+	for (int i = 0; i < run->numberOfPointers; ++i) {
+		XIAnyHierarchyChangeInfo change;
+		change.remove.type = XIRemoveMaster;
+		change.remove.deviceid = run->pointers[i];
+		change.remove.return_mode = XIFloating;
+		XIChangeHierarchy(run->disp, &change, 1);
+	}
+	run->numberOfPointers = 0;
+	XSync(run->disp, False);
+}
+#else
+static void addPointers(LoadRun *run, int count)
+{
+	(void)run;
+	(void)count;
+	philError("xdnd_loadgen: -x needs XInput2 (make XINPUT2=1)");
+}
+
+static void movePointer(LoadRun *run, LoadDrag *drag, int x, int y)
+{
+	(void)run;
+	(void)drag;
+	(void)x;
+	(void)y;
+}
+
+static void removePointers(LoadRun *run)
+{
+	(void)run;
+}
+#endif
+
+/* This finds one of the atoms the windows use, by name */
+static Atom findXdndAtom(const char *name)
+{
+	for (int i = 0; i < getXdndAtomCount(); ++i) {
+		if (strcmp(getXdndAtomName(i), name) == 0)
+			return getXdndAtom(i);
+	}
+	philError("xdnd_loadgen: no atom %s", name);
+	return None;
+}
+
+/* This works out where a target is on the screen, returning false if it isn't there */
+static bool addTarget(LoadRun *run, Window wind)
+{
+	XWindowAttributes attrs;
+	Window child;
+	LoadTarget *target = &run->targets[run->numberOfTargets];
+
+	if (run->numberOfTargets == MAX_TARGETS || !XGetWindowAttributes(run->disp, wind, &attrs))
+		return false;
+	memset(target, 0, sizeof(*target));
+	target->wind = wind;
+	target->width = attrs.width;
+	target->height = attrs.height;
+	XTranslateCoordinates(run->disp, wind, DefaultRootWindow(run->disp), 0, 0,
+		&target->rootX, &target->rootY, &child);
+	run->numberOfTargets++;
+	return true;
+}
+
+/* This finds every top-level window that says it speaks XDND */
+static void findTargets(LoadRun *run)
+{
+	Window rootReturn, parentReturn, *children;
+	unsigned int numberOfChildren;
+	Atom xdndAware = findXdndAtom("XdndAware");
+
+	if (!XQueryTree(run->disp, DefaultRootWindow(run->disp), &rootReturn, &parentReturn,
+		&children, &numberOfChildren))
+		return;
+	for (unsigned int i = 0; i < numberOfChildren; ++i) {
+		Atom actualType = None;
+		int actualFormat;
+		unsigned long numOfItems, bytesAfterReturn;
+		unsigned char *data = NULL;
+		if (XGetWindowProperty(run->disp, children[i], xdndAware, 0, 1, False, AnyPropertyType,
+			&actualType, &actualFormat, &numOfItems, &bytesAfterReturn, &data) != Success)
+			continue;
+		if (data)
+			XFree(data);
+		if (actualType != None)
+			addTarget(run, children[i]);
+	}
+	if (children)
+		XFree(children);
+}
+
+/* This finds the drag whose window an event came to, or NULL */
+static LoadDrag *findDrag(LoadRun *run, Window wind)
+{
+	for (size_t i = wind & run->byWindowMask; run->byWindow[i]; i = (i + 1) & run->byWindowMask) {
+		if (run->byWindow[i]->wind == wind)
+			return run->byWindow[i];
+	}
+	return NULL;
+}
+
+/* This opens the invisible windows, and lines each drag up for its turn to join */
+static void createDrags(LoadRun *run, uint64_t startNs, uint64_t rampNs)
+{
+	size_t capacity = 1;
+	while (capacity < (size_t)run->numberOfDrags * 2)
+		capacity *= 2;
+	run->byWindow = calloc(capacity, sizeof(LoadDrag *));
+	run->byWindowMask = capacity - 1;
+	run->drags = aligned_alloc(_Alignof(XdndSession), run->numberOfDrags * sizeof(LoadDrag));
+	if (!run->byWindow || !run->drags)
+		philError("malloc");
+	memset(run->drags, 0, run->numberOfDrags * sizeof(LoadDrag));
+
+	for (int i = 0; i < run->numberOfDrags; ++i) {
+		LoadDrag *drag = &run->drags[i];
+		drag->wind = XCreateWindow(run->disp, DefaultRootWindow(run->disp), -1, -1, 1, 1, 0,
+			CopyFromParent, InputOnly, CopyFromParent, 0, NULL);
+		drag->target = &run->targets[i % run->numberOfTargets];
+		drag->xdnd.peer = drag->target->wind;
+		drag->xdnd.owner = drag->wind;
+		drag->startNs = startNs + rampNs * i / run->numberOfDrags;
+		drag->nextTickNs = drag->startNs;
+
+		size_t slot = drag->wind & run->byWindowMask;
+		while (run->byWindow[slot])
+			slot = (slot + 1) & run->byWindowMask;
+		run->byWindow[slot] = drag;
+	}
+}
+
+/* This puts a drag back to the start, ready to enter again on its next tick */
+static void resetDrag(LoadDrag *drag)
+{
+	drag->xdnd.role = RoleNone;
+	drag->xdnd.phase = PhaseIdle;
+	drag->awaitingReply = false;
+	drag->positionsSent = 0;
+	if (drag->target->dropping == &drag->xdnd)
+		drag->target->dropping = NULL;
+}
+
+/* This sends a message the drag must wait for an answer to */
+static void awaitReply(LoadDrag *drag, uint64_t now)
+{
+	drag->awaitingReply = true;
+	drag->waitingSinceNs = now;
+}
+
+/* This sends the next XdndPosition, somewhere over the target */
+static void sendPosition(LoadRun *run, LoadDrag *drag, uint64_t now)
+{
+	LoadTarget *target = drag->target;
+	int x = target->rootX + (drag->positionsSent * 7 + (int)(drag - run->drags)) % target->width;
+	int y = target->rootY + (drag->positionsSent * 3 + (int)(drag - run->drags)) % target->height;
+
+	movePointer(run, drag, x, y);
+	sendXdndPosition(run->disp, drag->wind, &drag->xdnd, CurrentTime, x, y, run->actionCopy);
+	drag->positionsSent++;
+	awaitReply(drag, now);
+}
+
+/* This moves a drag on when its next message is due - entering, moving over the target,
+ * then dropping - unless it is still waiting for the target */
+static void tickDrag(LoadRun *run, LoadDrag *drag, uint64_t now)
+{
+	LoadTarget *target = drag->target;
+
+	drag->nextTickNs = now + run->periodNs;
+	if (!drag->started) {
+		drag->started = true;
+		target->activeDrags++;
+	}
+	if (target->gone)
+		return;
+	target->ticks++;
+	target->secondTicks++;
+
+	if (drag->awaitingReply) {
+		target->waitingTicks++;
+		target->secondWaitingTicks++;
+		if (now - drag->waitingSinceNs < run->timeoutNs)
+			return;
+
+		// Give up, and start over
+		target->timeouts++;
+		if (drag->xdnd.phase != PhaseDropping)
+			sendXdndLeave(run->disp, drag->wind, &drag->xdnd);
+		resetDrag(drag);
+		return;
+	}
+
+	switch (drag->xdnd.phase) {
+	case PhaseIdle:
+		sendXdndEnter(run->disp, 5, drag->wind, &drag->xdnd, &run->uriList, 1);
+		drag->xdnd.role = RoleSource;
+		drag->xdnd.phase = PhaseNegotiating;
+		sendPosition(run, drag, now);
+		break;
+	case PhaseAccepted:
+		if (drag->positionsSent < run->positionsPerDrag) {
+			sendPosition(run, drag, now);
+			break;
+		}
+		sendXdndDrop(run->disp, drag->wind, &drag->xdnd);
+		drag->xdnd.phase = PhaseDropping;
+		target->dropping = &drag->xdnd;
+		awaitReply(drag, now);
+		break;
+	default:
+		break;
+	}
+}
+
+/* This takes an answer from a target */
+static void handleReply(LoadRun *run, XClientMessageEvent *message, uint64_t now)
+{
+	LoadDrag *drag = findDrag(run, message->window);
+	if (!drag || !drag->awaitingReply)
+		return;
+	LoadTarget *target = drag->target;
+
+	if (message->message_type == run->status && drag->xdnd.phase != PhaseDropping) {
+		double latencyMs = (now - drag->waitingSinceNs) / 1e6;
+		target->statusReplies++;
+		target->secondReplies++;
+		target->latencyTotalMs += latencyMs;
+		target->secondLatencyTotalMs += latencyMs;
+		if (latencyMs > target->latencyMaxMs)
+			target->latencyMaxMs = latencyMs;
+		drag->awaitingReply = false;
+
+		// A target that won't take the drop is left, and the drag starts again
+		if (!(message->data.l[1] & 0x1)) {
+			target->rejected++;
+			sendXdndLeave(run->disp, drag->wind, &drag->xdnd);
+			resetDrag(drag);
+			return;
+		}
+		drag->xdnd.phase = PhaseAccepted;
+	} else if (message->message_type == run->finished && drag->xdnd.phase == PhaseDropping) {
+		// Only a drop the target says it performed counts
+		if (message->data.l[1] & 0x1) {
+			target->drops++;
+			target->secondDrops++;
+		} else {
+			target->failedDrops++;
+		}
+		resetDrag(drag);
+	}
+}
+
+/* This hands the payload over when a target converts the selection */
+static void handleSelectionRequest(LoadRun *run, XSelectionRequestEvent *request)
+{
+	for (int i = 0; i < run->numberOfTargets; ++i) {
+		LoadTarget *target = &run->targets[i];
+		if (target->wind == request->requestor && target->dropping) {
+			sendSelectionNotify(run->disp, target->dropping, request, run->pathStr);
+			return;
+		}
+	}
+}
+
+/* This stops dragging onto targets that have gone away */
+static void handleErrors(LoadRun *run)
+{
+	XPeerError error;
+
+	while (takeXPeerError(&error)) {
+		for (int i = 0; i < run->numberOfTargets; ++i) {
+			LoadTarget *target = &run->targets[i];
+			if (target->wind == error.peer && !target->gone) {
+				printf("target 0x%lx failed a request (X error %d), leaving it alone\n",
+					target->wind, error.errorCode);
+				target->gone = true;
+			}
+		}
+	}
+}
+
+/* This prints how each target got on over the last second, and spots where its replies
+ * started queueing */
+static void reportSecond(LoadRun *run, double elapsedS)
+{
+	for (int i = 0; i < run->numberOfTargets; ++i) {
+		LoadTarget *target = &run->targets[i];
+		double waiting = target->secondTicks ?
+			100.0 * target->secondWaitingTicks / target->secondTicks : 0;
+
+		printf("%6.1f s  0x%lx: %5d drags, %6lu drops/s, status mean %8.3f ms, %5.1f%% waiting\n",
+			elapsedS, target->wind, target->activeDrags, target->secondDrops,
+			target->secondReplies ? target->secondLatencyTotalMs / target->secondReplies : 0,
+			waiting);
+		if (target->queueingAt == 0 && waiting > 10) {
+			target->queueingAt = target->activeDrags;
+			target->queueingAfterS = elapsedS;
+		}
+		target->secondDrops = target->secondReplies = 0;
+		target->secondTicks = target->secondWaitingTicks = 0;
+		target->secondLatencyTotalMs = 0;
+	}
+}
+
+/* Entry point */
+int main(int argc, char **argv)
+{
+	// Variables
+	int opt, rate = 50, seconds = 10, timeoutMs = 1000, kilobytes = 0, pointers = 0;
+	Window targetWindows[MAX_TARGETS];
+	int numberOfTargetWindows = 0;
+	LoadRun run;
+
+	memset(&run, 0, sizeof(run));
+	run.numberOfDrags = 100;
+	run.positionsPerDrag = 10;
+
+	// Parse options
+	while ((opt = getopt(argc, argv, "w:n:r:k:p:t:o:x:")) != -1) {
+		switch (opt) {
+		case 'w':
+			if (numberOfTargetWindows == MAX_TARGETS)
+				usage(argv[0]);
+			targetWindows[numberOfTargetWindows++] = strtoul(optarg, NULL, 0);
+			break;
+		case 'n':
+			run.numberOfDrags = atoi(optarg);
+			if (run.numberOfDrags <= 0)
+				usage(argv[0]);
+			break;
+		case 'r':
+			rate = atoi(optarg);
+			if (rate <= 0)
+				usage(argv[0]);
+			break;
+		case 'k':
+			run.positionsPerDrag = atoi(optarg);
+			if (run.positionsPerDrag <= 0)
+				usage(argv[0]);
+			break;
+		case 'p':
+			kilobytes = atoi(optarg);
+			if (kilobytes < 0)
+				usage(argv[0]);
+			break;
+		case 't':
+			seconds = atoi(optarg);
+			if (seconds <= 0)
+				usage(argv[0]);
+			break;
+		case 'o':
+			timeoutMs = atoi(optarg);
+			if (timeoutMs <= 0)
+				usage(argv[0]);
+			break;
+		case 'x':
+			pointers = atoi(optarg);
+			if (pointers <= 0 || pointers > MAX_POINTERS)
+				usage(argv[0]);
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc)
+		usage(argv[0]);
+
+	// Connect, with the same atoms and error handling as the windows
+	run.disp = XOpenDisplay(NULL);
+	if (!run.disp)
+		philError("XOpenDisplay");
+	installXErrorTracker(run.disp);
+	initXdndAtoms(run.disp);
+	run.uriList = findXdndAtom("text/uri-list");
+	run.actionCopy = findXdndAtom("XdndActionCopy");
+	run.status = findXdndAtom("XdndStatus");
+	run.finished = findXdndAtom("XdndFinished");
+	run.selection = findXdndAtom("XdndSelection");
+	run.periodNs = 1000000000ULL / rate;
+	run.timeoutNs = (uint64_t)timeoutMs * 1000000;
+
+	// Find the targets
+	for (int i = 0; i < numberOfTargetWindows; ++i) {
+		if (!addTarget(&run, targetWindows[i]))
+			fprintf(stderr, "xdnd_loadgen: no window 0x%lx\n", targetWindows[i]);
+	}
+	if (numberOfTargetWindows == 0)
+		findTargets(&run);
+	if (run.numberOfTargets == 0) {
+		fprintf(stderr, "xdnd_loadgen: no targets to drag onto\n");
+		return EXIT_FAILURE;
+	}
+
+	// Write the payload every drop hands over - targets are only offered copies, so it
+	// stays put
+	Square square = { .size = 50, .visible = true, .colour = BlueSquare };
+	snprintf(run.pathStr, sizeof(run.pathStr), "/tmp/xdnd_loadgen.%d.state", (int)getpid());
+	saveSquareState(&square, run.pathStr, (size_t)kilobytes * 1024);
+
+	// One window owns the selection for all the drags
+	run.owner = XCreateWindow(run.disp, DefaultRootWindow(run.disp), -1, -1, 1, 1, 0,
+		CopyFromParent, InputOnly, CopyFromParent, 0, NULL);
+	XSetSelectionOwner(run.disp, run.selection, run.owner, CurrentTime);
+
+	if (pointers > 0)
+		addPointers(&run, pointers);
+	if ((run.numberOfDrags + run.numberOfTargets - 1) / run.numberOfTargets > XDND_SESSION_CAPACITY)
+		printf("more drags per target than xlib_xdnd_test has room for (%d) - the rest will "
+			"be ignored\n", XDND_SESSION_CAPACITY);
+
+	uint64_t startNs = nowNs(), endNs = startNs + (uint64_t)seconds * 1000000000ULL;
+	createDrags(&run, startNs, (endNs - startNs) / 2);
+	printf("%d drags onto %d target(s), %d positions/s each, %d positions per drop, "
+		"%d KB payloads, %d s\n", run.numberOfDrags, run.numberOfTargets, rate,
+		run.positionsPerDrag, kilobytes, seconds);
+	if (run.numberOfPointers > 0)
+		printf("moving %d master pointers of our own with the drags\n", run.numberOfPointers);
+
+	// Run
+	uint64_t nextReportNs = startNs + 1000000000ULL, now;
+	while ((now = nowNs()) < endNs) {
+		while (XPending(run.disp) > 0) {
+			XEvent event;
+			XNextEvent(run.disp, &event);
+			if (event.type == ClientMessage)
+				handleReply(&run, &event.xclient, nowNs());
+			else if (event.type == SelectionRequest)
+				handleSelectionRequest(&run, &event.xselectionrequest);
+		}
+		if (hasXPeerErrors())
+			handleErrors(&run);
+
+		now = nowNs();
+		for (int i = 0; i < run.numberOfDrags; ++i) {
+			if (run.drags[i].nextTickNs <= now)
+				tickDrag(&run, &run.drags[i], now);
+		}
+		if (now >= nextReportNs) {
+			reportSecond(&run, (now - startNs) / 1e9);
+			nextReportNs += 1000000000ULL;
+		}
+
+		// Sleep until the X connection has something, or a millisecond has gone
+		XFlush(run.disp);
+		struct pollfd fd = { .fd = ConnectionNumber(run.disp), .events = POLLIN };
+		if (poll(&fd, 1, 1) < 0 && errno != EINTR)
+			philError("poll");
+	}
+
+	// Leave every target we are still over, then report
+	for (int i = 0; i < run.numberOfDrags; ++i) {
+		LoadDrag *drag = &run.drags[i];
+		if (!drag->target->gone && (drag->xdnd.phase == PhaseNegotiating ||
+			drag->xdnd.phase == PhaseAccepted))
+			sendXdndLeave(run.disp, drag->wind, &drag->xdnd);
+	}
+	removePointers(&run);
+	XSync(run.disp, False);
+
+	printf("%-10s %8s %10s %8s %10s %10s %10s %10s %12s\n", "target", "drops", "drops/s",
+		"failed", "mean ms", "worst ms", "rejected", "timeouts", "queueing at");
+	for (int i = 0; i < run.numberOfTargets; ++i) {
+		LoadTarget *target = &run.targets[i];
+		char queueing[32] = "never";
+		if (target->queueingAt > 0)
+			snprintf(queueing, sizeof(queueing), "%d drags", target->queueingAt);
+		printf("0x%-8lx %8lu %10.1f %8lu %10.3f %10.3f %10lu %10lu %12s\n", target->wind,
+			target->drops, target->drops / (double)seconds, target->failedDrops,
+			target->statusReplies ? target->latencyTotalMs / target->statusReplies : 0,
+			target->latencyMaxMs, target->rejected, target->timeouts, queueing);
+	}
+
+	unlink(run.pathStr);
+	free(run.drags);
+	free(run.byWindow);
+	XCloseDisplay(run.disp);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,360 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This drives xlib_xdnd_test on a live X server - normally Xvfb, through make xvfb-check -
+ * with two master pointers at once, and checks that both of their drops land. A second
+ * master is added with XIChangeHierarchy. Each master is moved with XIWarpPointer, and has
+ * button 1 pressed and released through XTest on the XTEST slave attached to it, so the
+ * windows see every press, motion and release as coming from that master.
+ *
+ * The core pointer drags the square from Phil to Stuart while the second pointer moves
+ * about over Stuart. Then the second pointer picks the square up where it landed and drags
+ * it back to Phil, while the core pointer moves about over Stuart and clicks. A drop has
+ * landed once the square is drawn, in red, where it was released. Both windows are then
+ * closed with WM_DELETE_WINDOW.
+ *
+ * xlib_xdnd_test has to be built with make XINPUT2=1 - without XInput2 the windows can't
+ * tell the two pointers apart, and the check fails */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/extensions/XInput.h>
+#include <X11/extensions/XInput2.h>
+#include <X11/extensions/XTest.h>
+#include "phil_error.h"
+
+// Where the windows are put, on the root window
+#define PHIL_X 0
+#define STUART_X 300
+
+// How long to wait for the windows to appear, a drop to land, or the windows to close
+#define WAIT_MS 5000
+
+// Motion steps in each drag, and the pause after each
+#define DRAG_STEPS 40
+#define STEP_US 10000
+
+// The colour the square is drawn in at first, as spawn_window.c sets it
+#define RED_PIXEL (0xFFUL << 16)
+
+// One master pointer, and the XTEST slave its buttons are pressed through
+typedef struct {
+	int master;
+	XDevice *xtest;
+} CheckPointer;
+
+// One of xlib_xdnd_test's windows
+typedef struct {
+	const char *name;
+	Window wind;
+	int rootX;
+	int rootY;
+} CheckWindow;
+
+/* Print usage and exit */
+static void usage(const char *progName)
+{
+	fprintf(stderr, "Usage: %s [program]\n", progName);
+	fprintf(stderr, "  program  the xlib_xdnd_test to run, built with make XINPUT2=1\n"
+			"           (default ./xlib_xdnd_test)\n");
+	exit(EXIT_FAILURE);
+}
+
+// This reports a failed check and exits
+static void failCheck(const char *reason)
+{
+	printf("xdnd_mpx_check: FAIL - %s\n", reason);
+	exit(EXIT_FAILURE);
+}
+
+// This sleeps for a number of milliseconds
+static void sleepMs(int milliseconds)
+{
+	usleep((useconds_t)milliseconds * 1000);
+}
+
+// This finds a top-level window by name, returning None if there isn't one mapped yet
+static Window findWindow(Display *disp, const char *name)
+{
+	Window rootReturn, parentReturn, *children;
+	unsigned int numberOfChildren;
+	Window found = None;
+
+	if (!XQueryTree(disp, DefaultRootWindow(disp), &rootReturn, &parentReturn, &children,
+		&numberOfChildren))
+		return None;
+	for (unsigned int i = 0; i < numberOfChildren && found == None; ++i) {
+		char *windowName;
+		XWindowAttributes attrs;
+		if (!XFetchName(disp, children[i], &windowName))
+			continue;
+		if (strcmp(windowName, name) == 0 && XGetWindowAttributes(disp, children[i], &attrs) &&
+			attrs.map_state == IsViewable)
+			found = children[i];
+		XFree(windowName);
+	}
+	if (children)
+		XFree(children);
+
+	return found;
+}
+
+// This says whether a point on the root window shows the square's red, inside a window
+static bool isRedAt(Display *disp, CheckWindow *window, int rootX, int rootY)
+{
+	int x, y;
+	Window childReturn;
+
+	XTranslateCoordinates(disp, DefaultRootWindow(disp), window->wind, rootX, rootY, &x, &y,
+		&childReturn);
+	XImage *image = XGetImage(disp, window->wind, x, y, 1, 1, AllPlanes, ZPixmap);
+	if (!image)
+		return false;
+	bool red = XGetPixel(image, 0, 0) == RED_PIXEL;
+	XDestroyImage(image);
+
+	return red;
+}
+
+// This waits for a point to show red, or not to - false if it doesn't in time
+static bool waitForRed(Display *disp, CheckWindow *window, int rootX, int rootY, bool red)
+{
+	for (int waited = 0; waited < WAIT_MS; waited += 10) {
+		if (isRedAt(disp, window, rootX, rootY) == red)
+			return true;
+		sleepMs(10);
+	}
+
+	return false;
+}
+
+// This adds a master pointer of our own, returning its device ID
+static int addMasterPointer(Display *disp, const char *name)
+{
+	XIAnyHierarchyChangeInfo change;
+	char pointerName[80];
+	int master = -1;
+
+	change.add.type = XIAddMaster;
+	change.add.name = (char *)name;
+	change.add.send_core = True;
+	change.add.enable = True;
+	if (XIChangeHierarchy(disp, &change, 1) != Success)
+		philError("XIChangeHierarchy");
+	XSync(disp, False);
+
+	// The server calls the new master pointer by our name plus " pointer"
+	int numberOfDevices;
+	XIDeviceInfo *devices = XIQueryDevice(disp, XIAllMasterDevices, &numberOfDevices);
+	snprintf(pointerName, sizeof(pointerName), "%s pointer", name);
+	for (int i = 0; i < numberOfDevices; ++i) {
+		if (devices[i].use == XIMasterPointer && strcmp(devices[i].name, pointerName) == 0)
+			master = devices[i].deviceid;
+	}
+	XIFreeDeviceInfo(devices);
+	if (master < 0)
+		failCheck("the new master pointer did not appear");
+
+	return master;
+}
+
+// This removes a master pointer we added
+static void removeMasterPointer(Display *disp, int master)
+{
+	XIAnyHierarchyChangeInfo change;
+
+	change.remove.type = XIRemoveMaster;
+	change.remove.deviceid = master;
+	change.remove.return_mode = XIFloating;
+	XIChangeHierarchy(disp, &change, 1);
+	XSync(disp, False);
+}
+
+// This opens the XTEST slave pointer attached to a master, so its buttons can be pressed
+static void openPointer(Display *disp, CheckPointer *pointer, int master)
+{
+	int numberOfDevices;
+	XIDeviceInfo *devices = XIQueryDevice(disp, XIAllDevices, &numberOfDevices);
+	int slave = -1;
+
+	for (int i = 0; i < numberOfDevices; ++i) {
+		if (devices[i].use == XISlavePointer && devices[i].attachment == master &&
+			strstr(devices[i].name, "XTEST"))
+			slave = devices[i].deviceid;
+	}
+	XIFreeDeviceInfo(devices);
+	if (slave < 0)
+		failCheck("a master pointer has no XTEST slave");
+
+	pointer->master = master;
+	pointer->xtest = XOpenDevice(disp, slave);
+	if (!pointer->xtest)
+		failCheck("could not open an XTEST slave pointer");
+}
+
+// This moves a master pointer to a point on the root window
+static void movePointer(Display *disp, CheckPointer *pointer, int rootX, int rootY)
+{
+	XIWarpPointer(disp, pointer->master, None, DefaultRootWindow(disp), 0, 0, 0, 0, rootX, rootY);
+}
+
+// This presses or releases button 1 on a master pointer, wherever it is
+static void pressButton(Display *disp, CheckPointer *pointer, bool press)
+{
+	XTestFakeDeviceButtonEvent(disp, pointer->xtest, 1, press, NULL, 0, CurrentTime);
+	XSync(disp, False);
+}
+
+// This drags with one pointer from one point to another, in steps, while the other pointer
+// wanders from one point to another alongside - it clicks halfway if asked
+static void dragWhileWandering(Display *disp, CheckPointer *dragging, int fromX, int fromY,
+	int toX, int toY, CheckPointer *wandering, int wanderFromX, int wanderFromY, int wanderToX,
+	int wanderToY, bool wandererClicks)
+{
+	movePointer(disp, dragging, fromX, fromY);
+	XSync(disp, False);
+	sleepMs(50);
+	pressButton(disp, dragging, true);
+
+	for (int step = 1; step <= DRAG_STEPS; ++step) {
+		movePointer(disp, dragging, fromX + (toX - fromX) * step / DRAG_STEPS,
+			fromY + (toY - fromY) * step / DRAG_STEPS);
+		movePointer(disp, wandering, wanderFromX + (wanderToX - wanderFromX) * step / DRAG_STEPS,
+			wanderFromY + (wanderToY - wanderFromY) * step / DRAG_STEPS);
+		if (wandererClicks && step == DRAG_STEPS / 2) {
+			pressButton(disp, wandering, true);
+			pressButton(disp, wandering, false);
+		}
+		XSync(disp, False);
+		usleep(STEP_US);
+	}
+
+	pressButton(disp, dragging, false);
+}
+
+// This asks one of the windows to close
+static void closeWindow(Display *disp, CheckWindow *window)
+{
+	XEvent event;
+
+	memset(&event, 0, sizeof(event));
+	event.xclient.type = ClientMessage;
+	event.xclient.window = window->wind;
+	event.xclient.message_type = XInternAtom(disp, "WM_PROTOCOLS", False);
+	event.xclient.format = 32;
+	event.xclient.data.l[0] = XInternAtom(disp, "WM_DELETE_WINDOW", False);
+	event.xclient.data.l[1] = CurrentTime;
+	XSendEvent(disp, window->wind, False, NoEventMask, &event);
+}
+
+// This waits for the program to exit, killing it if it takes too long - false if it had to
+static bool waitForExit(pid_t program)
+{
+	for (int waited = 0; waited < WAIT_MS; waited += 10) {
+		if (waitpid(program, NULL, WNOHANG) == program)
+			return true;
+		sleepMs(10);
+	}
+	kill(program, SIGKILL);
+	waitpid(program, NULL, 0);
+
+	return false;
+}
+
+/* Entry point */
+int main(int argc, char **argv)
+{
+	// Variables
+	const char *programPath = "./xlib_xdnd_test";
+	CheckWindow phil = { .name = "Phil", .rootX = PHIL_X }, stuart = { .name = "Stuart", .rootX = STUART_X };
+	CheckPointer core, second;
+	int opcode, event, error, major = 2, minor = 0;
+
+	if (argc > 2 || (argc == 2 && argv[1][0] == '-'))
+		usage(argv[0]);
+	if (argc == 2)
+		programPath = argv[1];
+
+	Display *disp = XOpenDisplay(NULL);
+	if (!disp)
+		philError("XOpenDisplay");
+	if (!XQueryExtension(disp, "XInputExtension", &opcode, &event, &error) ||
+		XIQueryVersion(disp, &major, &minor) != Success || major < 2)
+		failCheck("the X server has no XInput 2");
+	if (!XTestQueryExtension(disp, &event, &error, &major, &minor))
+		failCheck("the X server has no XTest");
+
+	// Start the windows, and wait until Phil has drawn its square
+	pid_t program = fork();
+	if (program < 0)
+		philError("fork");
+	if (program == 0) {
+		execl(programPath, programPath, (char *)NULL);
+		philError("execl");
+	}
+	for (int waited = 0; waited < WAIT_MS && (phil.wind == None || stuart.wind == None);
+		waited += 10) {
+		phil.wind = findWindow(disp, phil.name);
+		stuart.wind = findWindow(disp, stuart.name);
+		sleepMs(10);
+	}
+	if (phil.wind == None || stuart.wind == None)
+		failCheck("the windows did not appear");
+	XMoveWindow(disp, phil.wind, phil.rootX, phil.rootY);
+	XMoveWindow(disp, stuart.wind, stuart.rootX, stuart.rootY);
+	XSync(disp, False);
+	if (!waitForRed(disp, &phil, phil.rootX + 25, phil.rootY + 25, true))
+		failCheck("Phil did not draw its square");
+
+	// The core pointer, and one more
+	openPointer(disp, &core, 2);
+	openPointer(disp, &second, addMasterPointer(disp, "xdnd check"));
+
+	// The core pointer takes the square over to Stuart, with the second one moving about
+	// over Stuart as it goes
+	int firstDropX = stuart.rootX + 100, firstDropY = stuart.rootY + 100;
+	dragWhileWandering(disp, &core, phil.rootX + 25, phil.rootY + 25, firstDropX, firstDropY,
+		&second, stuart.rootX + 180, stuart.rootY + 20, stuart.rootX + 20, stuart.rootY + 180,
+		false);
+	bool firstLanded = waitForRed(disp, &stuart, firstDropX, firstDropY, true);
+	printf("xdnd_mpx_check: core pointer's drop on Stuart %s\n",
+		firstLanded ? "landed" : "did not land");
+
+	// The second pointer takes it back to Phil, with the core pointer moving about and
+	// clicking over Stuart as it goes
+	int secondDropX = phil.rootX + 100, secondDropY = phil.rootY + 120;
+	bool secondLanded = false;
+	if (firstLanded) {
+		dragWhileWandering(disp, &second, firstDropX, firstDropY, secondDropX, secondDropY,
+			&core, stuart.rootX + 20, stuart.rootY + 20, stuart.rootX + 180, stuart.rootY + 180,
+			true);
+		secondLanded = waitForRed(disp, &phil, secondDropX, secondDropY, true) &&
+			waitForRed(disp, &stuart, firstDropX, firstDropY, false);
+		printf("xdnd_mpx_check: second pointer's drop on Phil %s\n",
+			secondLanded ? "landed" : "did not land");
+	}
+
+	// Close the windows and tidy up
+	XCloseDevice(disp, core.xtest);
+	XCloseDevice(disp, second.xtest);
+	removeMasterPointer(disp, second.master);
+	closeWindow(disp, &phil);
+	closeWindow(disp, &stuart);
+	XSync(disp, False);
+	bool exited = waitForExit(program);
+	XCloseDisplay(disp);
+
+	if (!firstLanded || !secondLanded)
+		failCheck("a drop did not land - was the program built with make XINPUT2=1?");
+	if (!exited)
+		failCheck("the windows did not close");
+	printf("xdnd_mpx_check: PASS\n");
+
+	return 0;
+}
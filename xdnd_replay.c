@@ -0,0 +1,402 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This replays a recorded event trace through the XDND handlers against a mock X connection,
+ * as fast as possible, and reports how long each kind of event took to handle. Run it under
+ * perf to see where the time goes. It also works out how long each XdndStatus reply would
+ * have taken had the events come in at the pace they were recorded at, queueing behind
+ * whatever was being handled before them - which is where a heavy frame drawn on the event
+ * loop's thread shows up. It can also log the XDND messages the window sent and where its
+ * square ended up, which `make check` compares against what each trace should give */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <X11/Xlib.h>
+#include "event_handler.h"
+#include "event_trace.h"
+#include "mock_xlib.h"
+#include "square_state.h"
+#include "xevent_type.h"
+#include "xerror_tracker.h"
+#include "phil_error.h"
+
+// Per-event-type cost accumulated over the replay
+typedef struct {
+	unsigned long count;
+	uint64_t totalNs;
+	uint64_t maxNs;
+	unsigned long roundTrips;
+	unsigned long requests;
+} ReplayStats;
+
+/* Where -m logs the messages the window sends, with the trace naming their atoms */
+static FILE *messageLog;
+static TraceReader *loggedTrace;
+
+/* Print usage and exit */
+static void usage(const char *progName)
+{
+	fprintf(stderr, "Usage: %s [-n iterations] [-d rounds] [-s size] [-c] [-l] [-p megabytes] [-x every]\n"
+		"       [-w passes] [-i] [-v] [-m log] trace\n", progName);
+	fprintf(stderr, "  -n  replay the trace this many times (default 1)\n"
+			"  -d  also time just the client message dispatch lookup, over\n"
+			"      this many rounds of the trace's messages\n"
+			"  -s  draw into a window this many pixels square (default 200)\n"
+			"  -c  draw with core X requests rather than a client-side image\n"
+			"  -l  write out dragged state only once the target asks for it,\n"
+			"      rather than as soon as the drag starts\n"
+			"  -p  pad dragged state with this many megabytes of preview data\n"
+			"  -x  in every this many iterations, have the peer window vanish once\n"
+			"      the first client message is in\n"
+			"  -w  draw each frame this many times over, to make a heavy scene\n"
+			"  -i  draw on the replaying thread, rather than a render thread\n"
+			"  -v  keep the handlers' own debug output\n"
+			"  -m  write the XDND messages the window sends, and where the square\n"
+			"      ends up after each iteration, to this file\n");
+	exit(EXIT_FAILURE);
+}
+
+/* Nanoseconds from the monotonic clock */
+static uint64_t nowNs(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/* Name an atom the trace recorded */
+static const char *getTraceAtomName(TraceReader *reader, Atom atom)
+{
+	if (atom == None)
+		return "None";
+	for (int i = 0; i < reader->numberOfAtoms; ++i) {
+		if (reader->atoms[i] == atom)
+			return reader->atomNames[i];
+	}
+	return "unknown";
+}
+
+/* Log a message the window sent, with what it says about the exchange */
+static void logSentMessage(Window wind, XEvent *event)
+{
+	if (event->type != ClientMessage)
+		return;
+
+	XClientMessageEvent *message = &event->xclient;
+	fprintf(messageLog, "%s to 0x%lx", getTraceAtomName(loggedTrace, message->message_type),
+		wind);
+	switch (getXdndMessage(message->message_type)) {
+	case MessagePosition:
+		fprintf(messageLog, " at %ld,%ld %s", (message->data.l[2] >> 16) & 0xFFFF,
+			message->data.l[2] & 0xFFFF, getTraceAtomName(loggedTrace, message->data.l[4]));
+		break;
+	case MessageStatus:
+		fprintf(messageLog, " %s %s", message->data.l[1] & 1 ? "accepting" : "refusing",
+			getTraceAtomName(loggedTrace, message->data.l[4]));
+		break;
+	case MessageFinished:
+		fprintf(messageLog, " %s %s", message->data.l[1] & 1 ? "succeeded" : "failed",
+			getTraceAtomName(loggedTrace, message->data.l[2]));
+		break;
+	default:
+		break;
+	}
+	fputc('\n', messageLog);
+}
+
+/* Add one handled event to a stats slot */
+static void accumulate(ReplayStats *slot, uint64_t elapsedNs, MockXStats *before, MockXStats *after)
+{
+	slot->count++;
+	slot->totalNs += elapsedNs;
+	if (elapsedNs > slot->maxNs)
+		slot->maxNs = elapsedNs;
+	slot->roundTrips += after->roundTrips - before->roundTrips;
+	slot->requests += after->requests - before->requests;
+}
+
+/* Print one row of the results table */
+static void printStats(const char *name, ReplayStats *slot)
+{
+	if (slot->count == 0)
+		return;
+	fprintf(stderr, "%-24s %10lu %12.1f %12.1f %10.2f %10.2f\n", name, slot->count,
+		(double)slot->totalNs / slot->count, (double)slot->maxNs,
+		(double)slot->roundTrips / slot->count, (double)slot->requests / slot->count);
+}
+
+/* Time the message and session to transition lookup on its own, for every client message
+ * in the trace */
+static void benchmarkDispatch(TraceReader *reader, int rounds)
+{
+	TraceRecord record;
+	XClientMessageEvent *messages = NULL;
+	size_t numOfMessages = 0, capacity = 0;
+	volatile uintptr_t sink = 0;
+
+	// Gather message types
+	rewindTraceReader(reader);
+	while (readTraceRecord(reader, &record)) {
+		if (record.type != ClientMessage)
+			continue;
+		if (numOfMessages == capacity) {
+			capacity = capacity ? capacity * 2 : 64;
+			messages = realloc(messages, capacity * sizeof(XClientMessageEvent));
+			if (!messages)
+				philError("realloc");
+		}
+		messages[numOfMessages++] = record.event.xclient;
+	}
+	if (numOfMessages == 0) {
+		fprintf(stderr, "dispatch: no client messages in trace\n");
+		return;
+	}
+
+	// Look each one up in turn
+	uint64_t start = nowNs();
+	for (int i = 0; i < rounds; ++i) {
+		for (size_t j = 0; j < numOfMessages; ++j) {
+			XdndSession *session;
+			sink += (uintptr_t)lookupXdndTransition(&messages[j], &session);
+		}
+	}
+	uint64_t elapsedNs = nowNs() - start;
+
+	fprintf(stderr, "dispatch: %.2f ns per message over %lu lookups\n",
+		(double)elapsedNs / ((double)rounds * numOfMessages), (unsigned long)rounds * numOfMessages);
+	free(messages);
+}
+
+/* Entry point */
+int main(int argc, char **argv)
+{
+	// Variables
+	int opt, iterations = 1, dispatchRounds = 0, vanishEvery = 0;
+	unsigned long vanished = 0, abandoned = 0;
+	bool verbose = false;
+	TraceReader reader;
+	TraceRecord record;
+	WindowContext ctx;
+	Display *disp;
+	ReplayStats eventStats[TRACE_DROP_LOADED + 1];
+	ReplayStats *messageStats;
+	SpawnOptions options = {
+		.finishAfterLoad = false,
+		.timeoutMs = 5000,
+		.tracePath = NULL,
+		.windowSize = 200,
+		.coreDrawing = false,
+		.lazyPayload = false,
+		.previewMegabytes = 0,
+		.scenePasses = 1,
+		.inlineRendering = false
+	};
+	ReplayStats replyStats = { 0 };
+
+	// Parse options
+	while ((opt = getopt(argc, argv, "n:d:s:clp:x:w:ivm:")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atoi(optarg);
+			if (iterations <= 0)
+				usage(argv[0]);
+			break;
+		case 'd':
+			dispatchRounds = atoi(optarg);
+			if (dispatchRounds <= 0)
+				usage(argv[0]);
+			break;
+		case 's':
+			options.windowSize = atoi(optarg);
+			if (options.windowSize < 50)
+				usage(argv[0]);
+			break;
+		case 'c':
+			options.coreDrawing = true;
+			break;
+		case 'l':
+			options.lazyPayload = true;
+			break;
+		case 'p':
+			options.previewMegabytes = atoi(optarg);
+			if (options.previewMegabytes < 0)
+				usage(argv[0]);
+			break;
+		case 'x':
+			vanishEvery = atoi(optarg);
+			if (vanishEvery <= 0)
+				usage(argv[0]);
+			break;
+		case 'w':
+			options.scenePasses = atoi(optarg);
+			if (options.scenePasses <= 0)
+				usage(argv[0]);
+			break;
+		case 'i':
+			options.inlineRendering = true;
+			break;
+		case 'v':
+			verbose = true;
+			break;
+		case 'm':
+			messageLog = fopen(optarg, "w");
+			if (!messageLog)
+				philError("fopen");
+			break;
+		default:
+			usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	// Open trace and set up a mock display that hands out the recorded atom values
+	openTraceReader(&reader, argv[optind]);
+	disp = createMockDisplay(reader.root);
+	for (int i = 0; i < reader.numberOfAtoms; ++i)
+		registerMockAtom(reader.atomNames[i], reader.atoms[i]);
+	initXdndAtoms(disp);
+	installXErrorTracker(disp);
+	if (messageLog) {
+		loggedTrace = &reader;
+		setMockSendHook(logSentMessage);
+	}
+
+	// Give dropped data something real to load, named like a payload our windows write so a
+	// move takes it over as theirs would be
+	Square stateSquare = { .colour = BlueSquare };
+	char statePath[64];
+	snprintf(statePath, sizeof(statePath), "/tmp/square.%d.0.state", (int)getpid());
+	setMockSelectionPath(statePath);
+
+	// Results go to stderr, so the handlers' chatter can be thrown away
+	if (!verbose && !freopen("/dev/null", "w", stdout))
+		philError("freopen");
+
+	memset(eventStats, 0, sizeof(eventStats));
+	messageStats = calloc(reader.numberOfAtoms + 1, sizeof(ReplayStats));
+	if (!messageStats)
+		philError("calloc");
+
+	// Draw the way the window would - on a render thread, into a client-side image, unless
+	// asked not to
+	Renderer renderer;
+	RenderThread renderThread;
+	const char *procStr = reader.isPhil ? "Phil" : "Stuart";
+	bool threaded = !options.inlineRendering && startRenderThread(&renderThread, disp,
+		reader.wind, options.windowSize, options.windowSize, options.coreDrawing,
+		options.scenePasses, procStr);
+	bool rendering = !threaded && !options.coreDrawing && initRenderer(&renderer, disp,
+		reader.wind, NULL, options.windowSize, options.windowSize, procStr);
+
+	// Replay
+	uint64_t replayStart = nowNs();
+	for (int i = 0; i < iterations; ++i) {
+		initWindowContext(&ctx, disp, reader.wind, NULL, rendering ? &renderer : NULL,
+			threaded ? &renderThread : NULL, reader.isPhil ? 0 : 1, &options);
+		rewindTraceReader(&reader);
+		uint64_t busyUntilNs = 0;
+		bool vanishing = vanishEvery > 0 && i % vanishEvery == vanishEvery - 1;
+
+		// A drop that moved the state took the file with it, so put it back
+		if (access(statePath, F_OK) != 0)
+			saveSquareState(&stateSquare, statePath, (size_t)options.previewMegabytes * 1024 * 1024);
+
+		while (ctx.continueEventLoop && readTraceRecord(&reader, &record)) {
+			MockXStats before = *getMockXStats();
+			uint64_t start = nowNs();
+			if (record.type == TRACE_DROP_LOADED) {
+				if (ctx.loader.busy)
+					handleDropLoaded(&ctx);
+			} else if (record.type == TRACE_POINTER_DEVICE) {
+				ctx.pointerDevice = record.device;
+			} else {
+				record.event.xany.display = disp;
+				handleEvent(&ctx, &record.event);
+			}
+			// The event loop deals with errors before its next event
+			if (hasXPeerErrors())
+				handleXErrors(&ctx);
+			if (vanishing && record.type == ClientMessage) {
+				setMockPeersVanished(reader.wind, true);
+				vanishing = false;
+				vanished++;
+			}
+			// As if the queue emptied after every event, which is the worst case
+			flushDragIcon(&ctx.icon);
+			uint64_t elapsedNs = nowNs() - start;
+
+			// Had it come when it was recorded, it would have waited for the events before it
+			uint64_t startNs = record.timestampNs > busyUntilNs ? record.timestampNs : busyUntilNs;
+			busyUntilNs = startNs + elapsedNs;
+			if (record.type == ClientMessage &&
+				getXdndMessage(record.event.xclient.message_type) == MessagePosition)
+				accumulate(&replyStats, busyUntilNs - record.timestampNs, &before, &before);
+
+			// Account by event type, and by message type for client messages
+			if (record.type > TRACE_DROP_LOADED)
+				continue;
+			accumulate(&eventStats[record.type], elapsedNs, &before, getMockXStats());
+			if (record.type == ClientMessage) {
+				int slot = reader.numberOfAtoms;
+				for (int j = 0; j < reader.numberOfAtoms; ++j) {
+					if (reader.atoms[j] == record.event.xclient.message_type) {
+						slot = j;
+						break;
+					}
+				}
+				accumulate(&messageStats[slot], elapsedNs, &before, getMockXStats());
+			}
+		}
+
+		if (messageLog)
+			fprintf(messageLog, "square %s, %s, at %d,%d\n", ctx.square.visible ? "shown" : "hidden",
+				ctx.square.colour == RedSquare ? "red" : "blue", ctx.square.x, ctx.square.y);
+		abandoned += ctx.abandonedAfterErrors;
+		destroyWindowContext(&ctx);
+		setMockPeersVanished(reader.wind, false);
+	}
+	uint64_t replayNs = nowNs() - replayStart;
+
+	// Report
+	fprintf(stderr, "%-24s %10s %12s %12s %10s %10s\n", "event", "count", "mean ns", "max ns",
+		"trips/ev", "reqs/ev");
+	for (int type = 0; type < TRACE_DROP_LOADED; ++type) {
+		XEvent fake = { .type = type };
+		printStats(getEventType(&fake), &eventStats[type]);
+	}
+	printStats("(drop loaded)", &eventStats[TRACE_DROP_LOADED]);
+	for (int i = 0; i < reader.numberOfAtoms; ++i) {
+		char name[64];
+		snprintf(name, sizeof(name), "  %s", reader.atomNames[i]);
+		printStats(name, &messageStats[i]);
+	}
+	printStats("  (other message)", &messageStats[reader.numberOfAtoms]);
+	fprintf(stderr, "replayed %d iteration(s) in %.3f ms\n", iterations, replayNs / 1e6);
+	if (replyStats.count > 0)
+		fprintf(stderr, "XdndStatus replies at the recorded pace (%s, %d pass%s per frame): "
+			"mean %.3f ms, worst %.3f ms\n", threaded ? "render thread" : "drawn inline",
+			options.scenePasses, options.scenePasses == 1 ? "" : "es",
+			replyStats.totalNs / 1e6 / replyStats.count, replyStats.maxNs / 1e6);
+	if (vanishEvery > 0)
+		fprintf(stderr, "peer vanished in %lu iteration(s): %lu X errors, %lu exchange(s) "
+			"abandoned\n", vanished, getMockXStats()->errors, abandoned);
+	if (dispatchRounds > 0)
+		benchmarkDispatch(&reader, dispatchRounds);
+
+	// Clean up
+	unlink(statePath);
+	free(messageStats);
+	if (threaded)
+		stopRenderThread(&renderThread);
+	if (rendering)
+		destroyRenderer(&renderer);
+	destroyMockDisplay(disp);
+	closeTraceReader(&reader);
+	if (messageLog && fclose(messageLog) != 0)
+		philError("fclose");
+
+	return 0;
+}
@@ -0,0 +1,133 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This is a fixed capacity table of XDND sessions keyed by peer window and our role, so a
+ * window can run exchanges with many peers at once - and can drag onto a peer while that
+ * peer drags onto it. Lookups are a hash and a short linear probe with no lock taken.
+ *
+ * Sessions are only created and released by the thread running the event loop. A slot is
+ * claimed under a sentinel key, set up, and only then published under the peer's window
+ * with a release store, so a lookup from any thread that matches a key sees the whole
+ * record. Nothing stops a session being released while another thread reads it, though,
+ * so other threads may only look up sessions the event loop is known to be keeping. A
+ * session that ends leaves a tombstone, so probes for keys after it carry on past, unless
+ * nothing follows it - then it and any tombstones just before it go back to being empty,
+ * so misses stay short */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <X11/Xlib.h>
+#include "xdnd_session.h"
+
+// Slot key values that are not windows
+#define EMPTY_SLOT ((Window)0)
+#define TOMBSTONE_SLOT ((Window)~0UL)
+#define CLAIMED_SLOT ((Window)~1UL)
+
+_Static_assert(sizeof(XdndSession) == 64, "XdndSession should fill exactly one cache line");
+
+// This picks the slot to start probing from
+static unsigned int hashWindow(Window peer)
+{
+	uint64_t hash = (uint64_t)peer * 0x9E3779B97F4A7C15ULL;
+	return (unsigned int)(hash >> 32) & (XDND_SESSION_CAPACITY - 1);
+}
+
+// This clears everything but the key, which comes first - None, RoleNone and PhaseIdle
+// are all zero
+static void clearSession(XdndSession *session)
+{
+	memset((char *)session + offsetof(XdndSession, owner), 0,
+		sizeof(*session) - offsetof(XdndSession, owner));
+}
+
+// This says whether a window could be a peer, rather than one of the slot markers
+static bool isPeerWindow(Window peer)
+{
+	return peer != EMPTY_SLOT && peer != TOMBSTONE_SLOT && peer != CLAIMED_SLOT;
+}
+
+// This finds the session in which we have the given role with a peer window, or returns
+// NULL if there isn't one. Sessions with the same peer share its probe sequence
+XdndSession *findXdndSession(XdndSessionTable *table, Window peer, XdndRole role)
+{
+	if (!isPeerWindow(peer))
+		return NULL;
+
+	unsigned int slot = hashWindow(peer);
+	for (int i = 0; i < XDND_SESSION_CAPACITY; ++i) {
+		// The role is only trusted if the key still matches once it has been read
+		XdndSession *session = &table->slots[slot];
+		Window key = atomic_load_explicit(&session->peer, memory_order_acquire);
+		if (key == peer && session->role == role &&
+			atomic_load_explicit(&session->peer, memory_order_acquire) == peer)
+			return session;
+		if (key == EMPTY_SLOT)
+			break;
+		slot = (slot + 1) & (XDND_SESSION_CAPACITY - 1);
+	}
+
+	return NULL;
+}
+
+// This claims a slot for a new session with a peer, in which we have the given role -
+// there must not already be one. Returns NULL if the table is full
+XdndSession *createXdndSession(XdndSessionTable *table, Window peer, Window owner, XdndRole role)
+{
+	if (!isPeerWindow(peer))
+		return NULL;
+
+	unsigned int slot = hashWindow(peer);
+	for (int i = 0; i < XDND_SESSION_CAPACITY; ++i) {
+		XdndSession *session = &table->slots[slot];
+		Window key = atomic_load_explicit(&session->peer, memory_order_relaxed);
+		if ((key == EMPTY_SLOT || key == TOMBSTONE_SLOT) &&
+			atomic_compare_exchange_strong_explicit(&session->peer, &key, CLAIMED_SLOT,
+				memory_order_acquire, memory_order_relaxed)) {
+			clearSession(session);
+			session->owner = owner;
+			session->role = role;
+			atomic_store_explicit(&session->peer, peer, memory_order_release);
+			return session;
+		}
+		slot = (slot + 1) & (XDND_SESSION_CAPACITY - 1);
+	}
+
+	return NULL;
+}
+
+// This ends a session and frees its slot, leaving a tombstone only if a probe might need
+// to carry on past it
+void releaseXdndSession(XdndSessionTable *table, XdndSession *session)
+{
+	unsigned int slot = session - table->slots;
+	unsigned int next = (slot + 1) & (XDND_SESSION_CAPACITY - 1);
+
+	// Take the key away before clearing, so no lookup matches a half-cleared record
+	atomic_store_explicit(&session->peer, CLAIMED_SLOT, memory_order_release);
+	clearSession(session);
+	if (atomic_load_explicit(&table->slots[next].peer, memory_order_relaxed) != EMPTY_SLOT) {
+		atomic_store_explicit(&session->peer, TOMBSTONE_SLOT, memory_order_release);
+		return;
+	}
+
+	// Nothing follows, so this slot and the tombstones leading up to it can be emptied
+	atomic_store_explicit(&session->peer, EMPTY_SLOT, memory_order_release);
+	for (int i = 1; i < XDND_SESSION_CAPACITY; ++i) {
+		slot = (slot - 1) & (XDND_SESSION_CAPACITY - 1);
+		if (atomic_load_explicit(&table->slots[slot].peer, memory_order_relaxed) != TOMBSTONE_SLOT)
+			break;
+		atomic_store_explicit(&table->slots[slot].peer, EMPTY_SLOT, memory_order_release);
+	}
+}
+
+// This ends every session belonging to one of our windows, for when it goes away
+void releaseXdndSessionsOwnedBy(XdndSessionTable *table, Window owner)
+{
+	for (int i = 0; i < XDND_SESSION_CAPACITY; ++i) {
+		XdndSession *session = &table->slots[i];
+		Window key = atomic_load_explicit(&session->peer, memory_order_acquire);
+		if (isPeerWindow(key) && session->owner == owner)
+			releaseXdndSession(table, session);
+	}
+}
@@ -0,0 +1,66 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for XDND sessions and the table they live in */
+#ifndef XDND_SESSION
+#define XDND_SESSION
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <X11/Xlib.h>
+
+// Table size - must be a power of two. Each source dragging onto a window takes a slot, so
+// this leaves room for a few thousand at once with the table still under half full
+#define XDND_SESSION_CAPACITY 4096
+
+// Who we are in an exchange
+typedef enum {
+	RoleNone = 0,
+	RoleSource,
+	RoleTarget,
+	NumberOfRoles
+} XdndRole;
+
+// How far an exchange has got
+typedef enum {
+	// No exchange in progress
+	PhaseIdle = 0,
+	// Source: XdndEnter sent, waiting for XdndStatus. Target: XdndEnter received, waiting
+	// for the first XdndPosition
+	PhaseNegotiating,
+	// Source: XdndStatus received. Target: XdndPosition received and XdndStatus sent
+	PhaseAccepted,
+	// Source: XdndDrop sent, waiting for XdndFinished. Target: XdndDrop received,
+	// converting the selection
+	PhaseDropping,
+	NumberOfPhases
+} XdndPhase;
+
+// One exchange with a peer window, packed into a single cache line. X timestamps and
+// coordinates are 32 and 16 bits on the wire, so they are stored that way
+typedef struct {
+	_Alignas(64) _Atomic Window peer;
+	Window owner;
+	Atom proposedAction;
+	Atom acceptedAction;
+	Atom proposedType;
+	Atom contentType;
+	uint32_t dropTimestamp;
+	uint32_t lastPositionTimestamp;
+	int16_t rootX;
+	int16_t rootY;
+	unsigned int role : 2;
+	unsigned int phase : 2;
+	unsigned int version : 3;
+	unsigned int typeList : 1;
+} XdndSession;
+
+// Fixed capacity session table, keyed by peer window and our role
+typedef struct {
+	XdndSession slots[XDND_SESSION_CAPACITY];
+} XdndSessionTable;
+
+XdndSession *findXdndSession(XdndSessionTable *table, Window peer, XdndRole role);
+XdndSession *createXdndSession(XdndSessionTable *table, Window peer, Window owner, XdndRole role);
+void releaseXdndSession(XdndSessionTable *table, XdndSession *session);
+void releaseXdndSessionsOwnedBy(XdndSessionTable *table, Window owner);
+
+#endif
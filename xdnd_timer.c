@@ -0,0 +1,178 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This wraps a timerfd used to time out stalled XDND exchanges, so a peer that dies
+ * or never answers cannot leave us stuck mid-exchange. Each exchange has a deadline of its
+ * own, kept in a short unsorted list - there are only as many as exchanges waiting on a
+ * peer - and the timerfd is set for whichever comes first */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "xdnd_timer.h"
+#include "phil_error.h"
+
+// This creates the timerfd and clears the counters
+void initXdndTimer(XdndTimer *timer)
+{
+	memset(timer, 0, sizeof(*timer));
+	timer->fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer->fd < 0)
+		philError("timerfd_create");
+}
+
+// This says whether one deadline comes before another
+static bool isEarlier(const struct timespec *a, const struct timespec *b)
+{
+	return a->tv_sec < b->tv_sec || (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+// This returns the index of the earliest deadline, or -1 if nothing is waiting
+static int findEarliest(XdndTimer *timer)
+{
+	int earliest = -1;
+
+	for (int i = 0; i < timer->pendingCount; ++i) {
+		if (earliest < 0 || isEarlier(&timer->pending[i].deadline, &timer->pending[earliest].deadline))
+			earliest = i;
+	}
+
+	return earliest;
+}
+
+// This returns the index of an exchange's timeout, or -1 if it has none
+static int findTimeout(XdndTimer *timer, void *exchange)
+{
+	for (int i = 0; i < timer->pendingCount; ++i) {
+		if (timer->pending[i].exchange == exchange)
+			return i;
+	}
+
+	return -1;
+}
+
+// This sets the timerfd for the earliest deadline, or stops it if nothing is waiting
+static void resetTimerFd(XdndTimer *timer)
+{
+	struct itimerspec spec;
+	uint64_t expirations;
+	int earliest = findEarliest(timer);
+
+	memset(&spec, 0, sizeof(spec));
+	if (earliest >= 0) {
+		spec.it_value = timer->pending[earliest].deadline;
+		// A zero time would stop the timer rather than fire it
+		if (spec.it_value.tv_sec == 0 && spec.it_value.tv_nsec == 0)
+			spec.it_value.tv_nsec = 1;
+	}
+	if (timerfd_settime(timer->fd, TFD_TIMER_ABSTIME, &spec, NULL) != 0)
+		philError("timerfd_settime");
+
+	// Swallow an expiry that raced with us, so poll does not wake for it
+	if (earliest < 0 && read(timer->fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+		philError("read");
+}
+
+// This drops the timeout at an index, moving the last one into its place
+static void removeTimeout(XdndTimer *timer, int index)
+{
+	timer->pending[index] = timer->pending[--timer->pendingCount];
+}
+
+// This starts (or restarts) a one-shot timeout for the given phase of an exchange, replacing
+// any the exchange already had - other exchanges' timeouts are left as they are
+void armXdndTimer(XdndTimer *timer, void *exchange, XdndTimeoutKind kind, int milliseconds)
+{
+	int index = findTimeout(timer, exchange);
+
+	if (index < 0) {
+		if (timer->pendingCount == timer->pendingCapacity) {
+			int capacity = timer->pendingCapacity > 0 ? timer->pendingCapacity * 2 : 8;
+			XdndTimeout *pending = realloc(timer->pending, capacity * sizeof(*pending));
+			if (!pending)
+				philError("realloc");
+			timer->pending = pending;
+			timer->pendingCapacity = capacity;
+		}
+		index = timer->pendingCount++;
+	}
+
+	XdndTimeout *timeout = &timer->pending[index];
+	timeout->exchange = exchange;
+	timeout->kind = kind;
+	clock_gettime(CLOCK_MONOTONIC, &timeout->deadline);
+	timeout->deadline.tv_sec += milliseconds / 1000;
+	timeout->deadline.tv_nsec += (long)(milliseconds % 1000) * 1000000;
+	if (timeout->deadline.tv_nsec >= 1000000000) {
+		timeout->deadline.tv_sec++;
+		timeout->deadline.tv_nsec -= 1000000000;
+	}
+	resetTimerFd(timer);
+}
+
+// This cancels an exchange's timeout, if it has one
+void disarmXdndTimer(XdndTimer *timer, void *exchange)
+{
+	int index = findTimeout(timer, exchange);
+
+	if (index < 0)
+		return;
+	removeTimeout(timer, index);
+	resetTimerFd(timer);
+}
+
+// This returns the descriptor that becomes readable when a timeout expires
+int getXdndTimerFd(XdndTimer *timer)
+{
+	return timer->fd;
+}
+
+// This takes the earliest timeout that has expired, counts it and reports which exchange
+// and phase it was for - false is returned once none are left, with the timerfd set for
+// the next. Call it until it returns false, as several may expire together
+bool expireXdndTimer(XdndTimer *timer, void **exchangeReturn, XdndTimeoutKind *kind)
+{
+	uint64_t expirations;
+	struct timespec now;
+
+	if (read(timer->fd, &expirations, sizeof(expirations)) < 0 && errno != EAGAIN)
+		philError("read");
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int earliest = findEarliest(timer);
+	if (earliest < 0 || isEarlier(&now, &timer->pending[earliest].deadline)) {
+		resetTimerFd(timer);
+		return false;
+	}
+
+	*exchangeReturn = timer->pending[earliest].exchange;
+	*kind = timer->pending[earliest].kind;
+	timer->timedOut[*kind]++;
+	removeTimeout(timer, earliest);
+
+	return true;
+}
+
+// This turns a timeout kind into a string
+const char *getXdndTimeoutName(XdndTimeoutKind kind)
+{
+	switch (kind) {
+	case StatusTimeout:
+		return "XdndStatus";
+	case SelectionNotifyTimeout:
+		return "SelectionNotify";
+	case FinishedTimeout:
+		return "XdndFinished";
+	default:
+		return "Unknown";
+	}
+}
+
+// This closes the timerfd and forgets any timeouts still waiting
+void destroyXdndTimer(XdndTimer *timer)
+{
+	free(timer->pending);
+	close(timer->fd);
+}
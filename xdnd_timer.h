@@ -0,0 +1,42 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for XDND protocol timeouts */
+#ifndef XDND_TIMER
+#define XDND_TIMER
+
+#include <stdbool.h>
+#include <time.h>
+
+// What we are waiting on the other window for
+typedef enum {
+	StatusTimeout = 0,
+	SelectionNotifyTimeout,
+	FinishedTimeout,
+	NumberOfTimeouts
+} XdndTimeoutKind;
+
+// One exchange's timeout - each exchange waits on one phase at a time
+typedef struct {
+	void *exchange;
+	XdndTimeoutKind kind;
+	struct timespec deadline;
+} XdndTimeout;
+
+// Timer structure - every exchange has its own deadline, and the timerfd is set for the
+// earliest of them
+typedef struct {
+	int fd;
+	XdndTimeout *pending;
+	int pendingCount;
+	int pendingCapacity;
+	unsigned long timedOut[NumberOfTimeouts];
+} XdndTimer;
+
+void initXdndTimer(XdndTimer *timer);
+void armXdndTimer(XdndTimer *timer, void *exchange, XdndTimeoutKind kind, int milliseconds);
+void disarmXdndTimer(XdndTimer *timer, void *exchange);
+int getXdndTimerFd(XdndTimer *timer);
+bool expireXdndTimer(XdndTimer *timer, void **exchangeReturn, XdndTimeoutKind *kind);
+const char *getXdndTimeoutName(XdndTimeoutKind kind);
+void destroyXdndTimer(XdndTimer *timer);
+
+#endif
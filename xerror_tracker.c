@@ -0,0 +1,150 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This replaces Xlib's default error handler, which exits, so a peer window that is
+ * destroyed mid-exchange only costs us that exchange. Requests made for a peer are
+ * bracketed by beginPeerRequests() and endPeerRequests(), which note the range of request
+ * serials they used - so no XSync is needed to find out which request failed. When an
+ * error comes in, whenever Xlib happens to read it, its serial is looked up in those ranges
+ * and the peer is queued for the event loop to abandon its exchange.
+ *
+ * The error handler is per process rather than per display, and may not make Xlib calls
+ * of its own, so all of this is module state and the handler only records what happened.
+ * Errors on any other connection - the render thread's - aren't ours to attribute, and are
+ * only printed. Ranges are kept in a ring, newest last, with consecutive ranges for the same peer
+ * merged - an error for a range that has fallen out of the ring, or for a request not made
+ * for a peer, is counted and otherwise ignored */
+#include <stdbool.h>
+#include <stdio.h>
+#include <X11/Xlib.h>
+#include "xerror_tracker.h"
+
+// One range of request serials, from first up to but not including end
+typedef struct {
+	unsigned long first;
+	unsigned long end;
+	Window peer;
+} RequestSpan;
+
+// Our connection, ranges made so far, the one still open, failed peers and counts
+static Display *trackedDisplay;
+static RequestSpan spans[XERROR_SPANS];
+static unsigned long numberOfSpans;
+static Window openPeer;
+static unsigned long openFirst;
+static XPeerError failures[XERROR_FAILURES];
+static unsigned long failureHead, failureTail;
+static XErrorCounts counts;
+
+// This finds which peer a request was made for, or None
+static Window findPeerForSerial(unsigned long serial)
+{
+	if (openPeer != None && serial >= openFirst)
+		return openPeer;
+
+	// Ranges only go up, so stop at the first one that ends before the serial
+	unsigned long oldest = numberOfSpans > XERROR_SPANS ? numberOfSpans - XERROR_SPANS : 0;
+	for (unsigned long i = numberOfSpans; i > oldest; --i) {
+		RequestSpan *span = &spans[(i - 1) & (XERROR_SPANS - 1)];
+		if (serial >= span->end)
+			break;
+		if (serial >= span->first)
+			return span->peer;
+	}
+	return None;
+}
+
+// This is called by Xlib for every error, from whichever call read it in
+static int trackXError(Display *disp, XErrorEvent *error)
+{
+	if (disp != trackedDisplay) {
+		fprintf(stderr, "X error %d from request %d (serial %lu) on another connection\n",
+			error->error_code, error->request_code, error->serial);
+		return 0;
+	}
+
+	Window peer = findPeerForSerial(error->serial);
+	if (peer == None) {
+		counts.unattributed++;
+		fprintf(stderr, "X error %d from request %d (serial %lu) not made for an exchange, "
+			"ignoring it\n", error->error_code, error->request_code, error->serial);
+		return 0;
+	}
+	counts.attributed++;
+
+	// One queued failure per peer is enough to abandon its exchange
+	for (unsigned long i = failureHead; i != failureTail; ++i) {
+		if (failures[i & (XERROR_FAILURES - 1)].peer == peer)
+			return 0;
+	}
+	if (failureTail - failureHead == XERROR_FAILURES) {
+		counts.dropped++;
+		return 0;
+	}
+
+	XPeerError *failure = &failures[failureTail++ & (XERROR_FAILURES - 1)];
+	failure->peer = peer;
+	failure->serial = error->serial;
+	failure->errorCode = error->error_code;
+	failure->requestCode = error->request_code;
+	return 0;
+}
+
+// This makes X errors come to us instead of exiting the process, attributing those on the
+// given connection
+void installXErrorTracker(Display *disp)
+{
+	trackedDisplay = disp;
+	XSetErrorHandler(trackXError);
+}
+
+// This marks the requests made from now on as being for a peer
+void beginPeerRequests(Display *disp, Window peer)
+{
+	openPeer = peer;
+	openFirst = NextRequest(disp);
+}
+
+// This ends the requests made for a peer, remembering their serials if there were any
+void endPeerRequests(Display *disp)
+{
+	unsigned long end = NextRequest(disp);
+	Window peer = openPeer;
+
+	openPeer = None;
+	if (end == openFirst)
+		return;
+
+	// Carry on the newest range if it was for the same peer and nothing came in between
+	if (numberOfSpans > 0) {
+		RequestSpan *newest = &spans[(numberOfSpans - 1) & (XERROR_SPANS - 1)];
+		if (newest->peer == peer && newest->end == openFirst) {
+			newest->end = end;
+			return;
+		}
+	}
+
+	RequestSpan *span = &spans[numberOfSpans++ & (XERROR_SPANS - 1)];
+	span->first = openFirst;
+	span->end = end;
+	span->peer = peer;
+}
+
+// This says whether any peer has failed a request since we last looked
+bool hasXPeerErrors(void)
+{
+	return failureHead != failureTail;
+}
+
+// This takes the oldest failed peer, returning false if there are none
+bool takeXPeerError(XPeerError *error)
+{
+	if (failureHead == failureTail)
+		return false;
+	*error = failures[failureHead++ & (XERROR_FAILURES - 1)];
+	return true;
+}
+
+// This gives the counts of errors seen so far
+const XErrorCounts *getXErrorCounts(void)
+{
+	return &counts;
+}
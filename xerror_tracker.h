@@ -0,0 +1,36 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for attributing asynchronous X errors to the exchanges that caused them */
+#ifndef XERROR_TRACKER
+#define XERROR_TRACKER
+
+#include <stdbool.h>
+#include <X11/Xlib.h>
+
+// Spans of requests remembered, and failed peers waiting to be dealt with - both must be
+// powers of two
+#define XERROR_SPANS 256
+#define XERROR_FAILURES 16
+
+// A request made for a peer that the server rejected
+typedef struct {
+	Window peer;
+	unsigned long serial;
+	unsigned char errorCode;
+	unsigned char requestCode;
+} XPeerError;
+
+// What the error handler has seen
+typedef struct {
+	unsigned long attributed;
+	unsigned long unattributed;
+	unsigned long dropped;
+} XErrorCounts;
+
+void installXErrorTracker(Display *disp);
+void beginPeerRequests(Display *disp, Window peer);
+void endPeerRequests(Display *disp);
+bool hasXPeerErrors(void);
+bool takeXPeerError(XPeerError *error);
+const XErrorCounts *getXErrorCounts(void);
+
+#endif
@@ -0,0 +1,182 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * This tracks the pointer with XInput2 events rather than core ones, when built with
+ * HAVE_XINPUT2 (make XINPUT2=1) and the server has XInput 2.0 or later. XI_Motion carries
+ * the pointer position as fixed point doubles, which we round to the nearest pixel rather
+ * than have the server truncate them, and is never compressed the way Xlib can merge core
+ * motion. Buttons and crossings come from XInput2 too, as only XInput2 says which master
+ * pointer they belong to - with MPX there can be several, each dragging on its own.
+ *
+ * Each event is turned into the matching core event in place, so the handlers, trace
+ * recording and replay all carry on seeing the events they already know, and the master
+ * pointer it came from is left in device. Without XInput2, initXi2Pointer() just returns
+ * false and core pointer events are used as before */
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include <X11/Xlib.h>
+#ifdef HAVE_XINPUT2
+#include <X11/extensions/XInput2.h>
+#endif
+#include "xi2_pointer.h"
+
+#ifdef HAVE_XINPUT2
+// This checks for XInput 2.0 and selects pointer events on our window from every master
+// pointer
+bool initXi2Pointer(Xi2Pointer *pointer, Display *disp, Window wind)
+{
+	int event, error, major = 2, minor = 0;
+	unsigned char mask[XIMaskLen(XI_LASTEVENT)];
+	XIEventMask eventMask;
+
+	memset(pointer, 0, sizeof(*pointer));
+	if (!XQueryExtension(disp, "XInputExtension", &pointer->opcode, &event, &error))
+		return false;
+	if (XIQueryVersion(disp, &major, &minor) != Success || major < 2)
+		return false;
+
+	memset(mask, 0, sizeof(mask));
+	XISetMask(mask, XI_Motion);
+	XISetMask(mask, XI_ButtonPress);
+	XISetMask(mask, XI_ButtonRelease);
+	XISetMask(mask, XI_Enter);
+	XISetMask(mask, XI_Leave);
+	eventMask.deviceid = XIAllMasterDevices;
+	eventMask.mask_len = sizeof(mask);
+	eventMask.mask = mask;
+	if (XISelectEvents(disp, wind, &eventMask, 1) != Success)
+		return false;
+
+	pointer->enabled = true;
+	return true;
+}
+
+// This turns the buttons held down in an XInput2 button mask into core state bits
+static unsigned int getButtonState(const XIButtonState *buttons)
+{
+	unsigned int state = 0;
+
+	for (int button = 1; button <= 5; ++button) {
+		if (button < buttons->mask_len * 8 && XIMaskIsSet(buttons->mask, button))
+			state |= Button1Mask << (button - 1);
+	}
+
+	return state;
+}
+
+// This fills in a core motion event from an XI_Motion one
+static void translateMotion(Display *disp, const XIDeviceEvent *deviceEvent, XMotionEvent *motion)
+{
+	memset(motion, 0, sizeof(*motion));
+	motion->type = MotionNotify;
+	motion->serial = deviceEvent->serial;
+	motion->send_event = deviceEvent->send_event;
+	motion->display = disp;
+	motion->window = deviceEvent->event;
+	motion->root = deviceEvent->root;
+	motion->subwindow = deviceEvent->child;
+	motion->time = deviceEvent->time;
+	motion->x = lround(deviceEvent->event_x);
+	motion->y = lround(deviceEvent->event_y);
+	motion->x_root = lround(deviceEvent->root_x);
+	motion->y_root = lround(deviceEvent->root_y);
+	motion->state = deviceEvent->mods.effective | getButtonState(&deviceEvent->buttons);
+	motion->is_hint = NotifyNormal;
+	motion->same_screen = True;
+}
+
+// This fills in a core button event from an XI_ButtonPress or XI_ButtonRelease one - like
+// core state, the button mask is from just before the event
+static void translateButton(Display *disp, const XIDeviceEvent *deviceEvent, XButtonEvent *button)
+{
+	memset(button, 0, sizeof(*button));
+	button->type = deviceEvent->evtype == XI_ButtonPress ? ButtonPress : ButtonRelease;
+	button->serial = deviceEvent->serial;
+	button->send_event = deviceEvent->send_event;
+	button->display = disp;
+	button->window = deviceEvent->event;
+	button->root = deviceEvent->root;
+	button->subwindow = deviceEvent->child;
+	button->time = deviceEvent->time;
+	button->x = lround(deviceEvent->event_x);
+	button->y = lround(deviceEvent->event_y);
+	button->x_root = lround(deviceEvent->root_x);
+	button->y_root = lround(deviceEvent->root_y);
+	button->state = deviceEvent->mods.effective | getButtonState(&deviceEvent->buttons);
+	button->button = deviceEvent->detail;
+	button->same_screen = True;
+}
+
+// This fills in a core crossing event from an XI_Enter or XI_Leave one
+static void translateCrossing(Display *disp, const XIEnterEvent *enterEvent, XCrossingEvent *crossing)
+{
+	memset(crossing, 0, sizeof(*crossing));
+	crossing->type = enterEvent->evtype == XI_Enter ? EnterNotify : LeaveNotify;
+	crossing->serial = enterEvent->serial;
+	crossing->send_event = enterEvent->send_event;
+	crossing->display = disp;
+	crossing->window = enterEvent->event;
+	crossing->root = enterEvent->root;
+	crossing->subwindow = enterEvent->child;
+	crossing->time = enterEvent->time;
+	crossing->x = lround(enterEvent->event_x);
+	crossing->y = lround(enterEvent->event_y);
+	crossing->x_root = lround(enterEvent->root_x);
+	crossing->y_root = lround(enterEvent->root_y);
+	crossing->mode = enterEvent->mode;
+	crossing->detail = enterEvent->detail;
+	crossing->same_screen = enterEvent->same_screen;
+	crossing->focus = enterEvent->focus;
+	crossing->state = enterEvent->mods.effective | getButtonState(&enterEvent->buttons);
+}
+
+// This rewrites an XInput2 pointer event as the core event the handlers expect, noting the
+// master pointer it came from, and returns false for anything else
+bool translateXi2Event(Xi2Pointer *pointer, Display *disp, XEvent *event)
+{
+	XGenericEventCookie *cookie = &event->xcookie;
+
+	if (!pointer->enabled || event->type != GenericEvent || cookie->extension != pointer->opcode)
+		return false;
+	if (cookie->evtype != XI_Motion && cookie->evtype != XI_ButtonPress &&
+		cookie->evtype != XI_ButtonRelease && cookie->evtype != XI_Enter &&
+		cookie->evtype != XI_Leave)
+		return false;
+	if (!XGetEventData(disp, cookie))
+		return false;
+
+	// Copy out of the cookie before the event it lives in is overwritten
+	XEvent core;
+	switch (cookie->evtype) {
+	case XI_Motion:
+		translateMotion(disp, cookie->data, &core.xmotion);
+		pointer->device = ((XIDeviceEvent *)cookie->data)->deviceid;
+		pointer->motionEvents++;
+		break;
+	case XI_ButtonPress:
+	case XI_ButtonRelease:
+		translateButton(disp, cookie->data, &core.xbutton);
+		pointer->device = ((XIDeviceEvent *)cookie->data)->deviceid;
+		pointer->buttonEvents++;
+		break;
+	default:
+		translateCrossing(disp, cookie->data, &core.xcrossing);
+		pointer->device = ((XIEnterEvent *)cookie->data)->deviceid;
+		break;
+	}
+	XFreeEventData(disp, cookie);
+
+	*event = core;
+	return true;
+}
+#else
+bool initXi2Pointer(Xi2Pointer *pointer, Display *disp, Window wind)
+{
+	memset(pointer, 0, sizeof(*pointer));
+	return false;
+}
+
+bool translateXi2Event(Xi2Pointer *pointer, Display *disp, XEvent *event)
+{
+	return false;
+}
+#endif
@@ -0,0 +1,22 @@
+/* Copyright xlib_xdnd contributors, 2026 - MIT License
+ * Header file for XInput2 pointer tracking */
+#ifndef XI2_POINTER
+#define XI2_POINTER
+
+#include <stdbool.h>
+#include <X11/Xlib.h>
+
+// XInput2 state - opcode is only meaningful while enabled is set, and device is the master
+// pointer behind the last event translated
+typedef struct {
+	bool enabled;
+	int opcode;
+	int device;
+	unsigned long motionEvents;
+	unsigned long buttonEvents;
+} Xi2Pointer;
+
+bool initXi2Pointer(Xi2Pointer *pointer, Display *disp, Window wind);
+bool translateXi2Event(Xi2Pointer *pointer, Display *disp, XEvent *event);
+
+#endif